@@ -0,0 +1,304 @@
+# -*- coding: utf-8 -*-
+"""Benchmarks of the placement and fitness hot paths
+
+Organisms are generated by the OrganismFactory, and sequences at random, from
+fixed seeds (BENCHMARK_SEED), so that two runs time exactly the same work.
+The benchmarks are:
+    - placement: get_placement, with and without traceback, for every number
+      of recognizers allowed by MAX_NODES, every PSSM length from MIN_COLUMNS
+      to MAX_COLUMNS and every length in BENCHMARK_SEQUENCE_LENGTHS
+    - fitness: each fitness function, on a population of random organisms
+    - mutate and get_children, on the same population
+    - generation: one full generation of deterministic crowding (produce,
+      evaluate and compete phases)
+
+Each benchmark is repeated BENCHMARK_REPEATS times and the fastest run is
+reported, as placements/second and cells/second (a cell is one entry of the
+placement matrix: one sequence position by one PSSM column). The placement
+cache and the placement checkpoints are disabled, so that every placement is
+actually computed.
+
+With BENCHMARK_OUTPUT_FORMAT "json" the results are written as JSON (to
+BENCHMARK_OUTPUT_FILENAME, or to the standard output if it's null), together
+with the placement engine settings, to compare runs of different backends.
+
+"""
+
+import sys
+import json
+import time
+import random
+import numpy as np
+import search_organisms
+from search_organisms import read_json_file
+from objects.organism_factory import OrganismFactory
+from objects.sequence_block_object import SequenceBlockObject
+from objects.dataset_object import DatasetObject
+from objects.placement_engine import BASES
+from objects import population_engine
+
+CONFIG_FILE = "config.json"
+
+FITNESS_FUNCTIONS = ["discriminative", "welchs", "kolmogorov", "boltzmannian"]
+
+
+def configure_search(config: dict) -> None:
+    """Sets the variables of search_organisms used by the fitness and the
+       generation benchmarks (without the side effects of set_up: no results
+       directory is created, and the run is serial).
+    """
+    conf_main = config["main"]
+    search_organisms.RUN_MODE = "serial"
+    search_organisms.MPI_PROTOCOL = conf_main["MPI_PROTOCOL"]
+    search_organisms.comm, search_organisms.rank, search_organisms.p = None, None, None
+    search_organisms.FITNESS_FUNCTION = conf_main["FITNESS_FUNCTION"]
+    search_organisms.GENOME_LENGTH = conf_main["GENOME_LENGTH"]
+    search_organisms.MAX_SEQUENCES_TO_FIT_POS = config["benchmark"]["BENCHMARK_SEQUENCES"]
+    search_organisms.MAX_SEQUENCES_TO_FIT_NEG = config["benchmark"]["BENCHMARK_SEQUENCES"]
+    search_organisms.EVALUATION_MODE = conf_main["EVALUATION_MODE"]
+    search_organisms.EARLY_ABORT_CHUNK_SIZE = conf_main["EARLY_ABORT_CHUNK_SIZE"]
+    search_organisms.RACING_MIN_SEQUENCES = conf_main["RACING_MIN_SEQUENCES"]
+    search_organisms.RACING_BATCH_SIZE = conf_main["RACING_BATCH_SIZE"]
+    search_organisms.RACING_T_THRESHOLD = conf_main["RACING_T_THRESHOLD"]
+    search_organisms.PLACEMENT_BATCH_SIZE = conf_main["PLACEMENT_BATCH_SIZE"]
+    search_organisms.check_placement_backend(
+        conf_main["PLACEMENT_BACKEND"], conf_main["EVALUATION_MODE"], "serial",
+        conf_main["MPI_PROTOCOL"])
+    search_organisms.PLACEMENT_BACKEND = population_engine.set_backend(
+        conf_main["PLACEMENT_BACKEND"])
+    search_organisms.MAX_NODES = config["organism"]["MAX_NODES"]
+    search_organisms.MIN_NODES = config["organism"]["MIN_NODES"]
+
+
+def set_seed(seed: int) -> None:
+    """Seeds the random generators used by the factory and the mutations.
+    """
+    random.seed(seed)
+    np.random.seed(seed)
+
+
+def get_random_sequences(number: int, length: int, seed: int) -> list:
+    """Returns a list of random DNA sequences (lowercase strings).
+    """
+    rng = np.random.RandomState(seed)
+    bases = np.array(BASES)
+    return ["".join(bases[rng.randint(0, 4, length)]) for _ in range(number)]
+
+
+def time_best(function, repeats: int) -> float:
+    """Runs function repeats times, and returns the time of the fastest run
+       (seconds).
+    """
+    best = float("inf")
+    for _ in range(repeats):
+        start = time.perf_counter()
+        function()
+        best = min(best, time.perf_counter() - start)
+    return best
+
+
+def get_result(benchmark: str, seconds: float, placements: int, cells: int,
+               **parameters) -> dict:
+    """Returns the record of a benchmark result.
+    """
+    result = {"benchmark": benchmark}
+    result.update(parameters)
+    result["seconds"] = seconds
+    result["placements_per_second"] = placements / seconds if seconds > 0 else None
+    result["cells_per_second"] = cells / seconds if seconds > 0 else None
+    return result
+
+
+def get_cells(organisms: list, sequence_lengths) -> int:
+    """Number of cells of the placement matrix of placing each organism on
+       each of the sequences.
+    """
+    total_length = int(np.sum(sequence_lengths))
+    return sum([org.sum_pssm_lengths() for org in organisms]) * total_length
+
+
+def benchmark_placement(factory, conf_bench: dict, conf_pssm: dict,
+                        max_nodes: int) -> list:
+    """Times get_placement for each number of recognizers, PSSM length and
+       sequence length.
+    """
+    seed = conf_bench["BENCHMARK_SEED"]
+    repeats = conf_bench["BENCHMARK_REPEATS"]
+    n_sequences = conf_bench["BENCHMARK_SEQUENCES"]
+    # An organism with r recognizers has 2r - 1 nodes
+    max_recognizers = (max_nodes + 1) // 2
+
+    results = []
+    for seq_length in conf_bench["BENCHMARK_SEQUENCE_LENGTHS"]:
+        sequences = get_random_sequences(n_sequences, seq_length, seed)
+        for n_recognizers in range(1, max_recognizers + 1):
+            for pwm_length in range(conf_pssm["MIN_COLUMNS"],
+                                    conf_pssm["MAX_COLUMNS"] + 1):
+                set_seed(seed)
+                org = factory.get_organism(n_recognizers, pwm_length)
+                cells = get_cells([org], [seq_length] * n_sequences)
+                for traceback in [False, True]:
+                    seconds = time_best(
+                        lambda: [org.get_placement(s, traceback=traceback)
+                                 for s in sequences], repeats)
+                    results.append(get_result(
+                        "placement", seconds, n_sequences, cells,
+                        recognizers=n_recognizers, pssm_length=pwm_length,
+                        sequence_length=seq_length, traceback=traceback))
+    return results
+
+
+def benchmark_population(factory, conf_bench: dict,
+                         fitness_function: str) -> list:
+    """Times the fitness functions, mutate, get_children and one generation
+       (with the given fitness function), on a population of random
+       organisms, for each sequence length.
+    """
+    seed = conf_bench["BENCHMARK_SEED"]
+    repeats = conf_bench["BENCHMARK_REPEATS"]
+    n_sequences = conf_bench["BENCHMARK_SEQUENCES"]
+    population_length = conf_bench["BENCHMARK_POPULATION_LENGTH"]
+
+    results = []
+    for seq_length in conf_bench["BENCHMARK_SEQUENCE_LENGTHS"]:
+        positive_dataset = DatasetObject(
+            get_random_sequences(n_sequences, seq_length, seed))
+        negative_dataset = DatasetObject(
+            get_random_sequences(n_sequences, seq_length, seed + 1))
+        positive_block = SequenceBlockObject(positive_dataset)
+        negative_block = SequenceBlockObject(negative_dataset)
+
+        set_seed(seed)
+        population = [factory.get_organism() for _ in range(population_length)]
+        # Both samples are placed by each fitness evaluation
+        placements = population_length * 2 * n_sequences
+        cells = get_cells(population, [seq_length] * (2 * n_sequences))
+
+        # Fitness functions
+        for function_name in FITNESS_FUNCTIONS:
+            search_organisms.FITNESS_FUNCTION = function_name
+            seconds = time_best(
+                lambda: [search_organisms.get_fitness(org, positive_block,
+                                                      negative_block)
+                         for org in population], repeats)
+            results.append(get_result(
+                "fitness", seconds, placements, cells,
+                fitness_function=function_name, sequence_length=seq_length,
+                population_length=population_length))
+
+        # Mutations (on clones, made outside of the timed function)
+        def mutate_clones(clones):
+            for org in clones:
+                org.mutate(factory)
+        best = float("inf")
+        for _ in range(repeats):
+            set_seed(seed)
+            clones = [org.clone() for org in population]
+            best = min(best, time_best(lambda: mutate_clones(clones), 1))
+        results.append(get_result(
+            "mutate", best, 0, 0, sequence_length=seq_length,
+            population_length=population_length))
+
+        # Recombination
+        def recombine():
+            for i in range(0, len(population) - 1, 2):
+                sample = random.sample(positive_dataset, 3)
+                factory.get_children(population[i], population[i + 1],
+                                     sample[0], sample)
+        set_seed(seed)
+        seconds = time_best(recombine, repeats)
+        results.append(get_result(
+            "get_children", seconds, 0, 0, sequence_length=seq_length,
+            population_length=population_length))
+
+        # One generation, from the same population in every run
+        search_organisms.FITNESS_FUNCTION = fitness_function
+        def generation():
+            organism_population = [org.clone() for org in population]
+            random.shuffle(organism_population)
+            competitions = search_organisms.get_competitions(
+                organism_population, positive_dataset, factory)
+            fitness_values = search_organisms.evaluate_competitions(
+                competitions, positive_block, negative_block, 0, None, factory)
+            for (pos_idx, parent, child), (fitness1, fitness2) in zip(
+                    competitions, fitness_values):
+                organism_population[pos_idx] = (parent if fitness1 > fitness2
+                                                else child)
+        best = float("inf")
+        for _ in range(repeats):
+            set_seed(seed)
+            best = min(best, time_best(generation, 1))
+        results.append(get_result(
+            "generation", best, 2 * placements, 2 * cells,
+            fitness_function=fitness_function,
+            evaluation_mode=search_organisms.EVALUATION_MODE,
+            sequence_length=seq_length, population_length=population_length))
+    return results
+
+
+def print_results(results: list) -> None:
+    """Prints the results as a table.
+    """
+    for result in results:
+        parameters = ", ".join(
+            ["{}={}".format(k, v) for k, v in result.items()
+             if k not in ["benchmark", "seconds", "placements_per_second",
+                          "cells_per_second"]])
+        line = "{:<13} {:>10.4f}s".format(result["benchmark"], result["seconds"])
+        if result["placements_per_second"]:
+            line += "  {:>12.1f} placements/s  {:>14.0f} cells/s".format(
+                result["placements_per_second"], result["cells_per_second"])
+        print(line + "  (" + parameters + ")")
+
+
+def main():
+    """Main execution for the benchmarks
+
+    """
+    #read configuration file
+    config = read_json_file(CONFIG_FILE)
+    conf_bench = config["benchmark"]
+    output_format = conf_bench["BENCHMARK_OUTPUT_FORMAT"]
+    if output_format not in ["text", "json"]:
+        raise ValueError('BENCHMARK_OUTPUT_FORMAT should be "text" or "json".')
+
+    # Every placement is computed: no cached placements nor checkpoints
+    conf_org = dict(config["organism"])
+    conf_org["PLACEMENT_CACHE_SIZE"] = 0
+    conf_org["PLACEMENT_CHECKPOINTS"] = 0
+
+    configure_search(config)
+    factory = OrganismFactory(conf_org, config["organismFactory"],
+                              config["connector"], config["pssm"], None)
+
+    results = benchmark_placement(factory, conf_bench, config["pssm"],
+                                  conf_org["MAX_NODES"])
+    results += benchmark_population(factory, conf_bench,
+                                    config["main"]["FITNESS_FUNCTION"])
+
+    if output_format == "text":
+        print_results(results)
+        return
+
+    report = {
+        "settings": {
+            "PLACEMENT_ENGINE": conf_org["PLACEMENT_ENGINE"],
+            "GAP_EVALUATION": conf_org["GAP_EVALUATION"],
+            "PLACEMENT_BACKEND": search_organisms.PLACEMENT_BACKEND,
+            "SCAN_REVERSE_COMPLEMENT": config["pssm"]["SCAN_REVERSE_COMPLEMENT"],
+            "BENCHMARK_SEED": conf_bench["BENCHMARK_SEED"],
+            "BENCHMARK_REPEATS": conf_bench["BENCHMARK_REPEATS"],
+        },
+        "results": results
+    }
+    if conf_bench["BENCHMARK_OUTPUT_FILENAME"] is None:
+        json.dump(report, sys.stdout, indent=2)
+        print()
+    else:
+        with open(conf_bench["BENCHMARK_OUTPUT_FILENAME"], "w") as output:
+            json.dump(report, output, indent=2)
+
+
+if __name__ == "__main__":
+
+    main()
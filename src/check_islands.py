@@ -0,0 +1,91 @@
+# -*- coding: utf-8 -*-
+"""Checks that a run with the islands protocol finishes when the islands stop
+at different generations
+
+To be run with MPI, e.g.
+    mpiexec -n 3 python3 check_islands.py
+The configuration file (CONFIG_FILE) is run with the islands protocol, a
+small population, shuffled samples and migrations at every generation. Each
+island stops after CHECK_ITERATIONS + CHECK_ITERATIONS_STEP * rank
+generations, so the islands finish at different times, with migrants and
+summaries still in flight. If the run hasn't finished on all the islands
+after CHECK_TIMEOUT seconds (a collective call blocking an island, for
+instance), it's aborted and the exit status is 1.
+
+"""
+
+import os
+import json
+import tempfile
+import threading
+import search_organisms
+from search_organisms import read_json_file
+
+CONFIG_FILE = "config.json"
+
+CHECK_ITERATIONS = 3
+CHECK_ITERATIONS_STEP = 4
+CHECK_POPULATION_LENGTH = 6
+CHECK_TIMEOUT = 600
+
+
+def get_check_config() -> dict:
+    """Returns the configuration of the check (islands protocol).
+    """
+    config = read_json_file(CONFIG_FILE)
+    conf_main = config["main"]
+    conf_main["RUN_MODE"] = "parallel"
+    conf_main["MPI_PROTOCOL"] = "islands"
+    conf_main["POPULATION_LENGTH"] = CHECK_POPULATION_LENGTH
+    conf_main["POPULATION_ORIGIN"] = "random"
+    conf_main["RANDOM_SHUFFLE_SAMPLING_POS"] = True
+    conf_main["RANDOM_SHUFFLE_SAMPLING_NEG"] = True
+    conf_main["END_WHILE_METHOD"] = "iterations"
+    conf_main["MIN_ITERATIONS"] = CHECK_ITERATIONS
+    conf_main["MIGRATION_INTERVAL"] = 1
+    conf_main["PERIODIC_CHECKPOINT"] = 0
+    conf_main["PRINT_PLACEMENT"] = False
+    return config
+
+
+def main():
+    """Main execution for the islands check
+
+    """
+    # Each process writes its own copy of the configuration
+    with tempfile.NamedTemporaryFile("w", suffix=".json",
+                                     delete=False) as config_file:
+        json.dump(get_check_config(), config_file)
+    search_organisms.JSON_CONFIG_FILENAME = config_file.name
+    try:
+        search_organisms.set_up()
+    finally:
+        os.remove(config_file.name)
+
+    comm = search_organisms.comm
+    rank = search_organisms.rank
+    # Uneven termination: the islands stop at different generations
+    search_organisms.MIN_ITERATIONS = CHECK_ITERATIONS + CHECK_ITERATIONS_STEP * rank
+
+    def abort():
+        print("Island {}: the run didn't finish in {}s".format(rank,
+                                                               CHECK_TIMEOUT),
+              flush=True)
+        comm.Abort(1)
+
+    watchdog = threading.Timer(CHECK_TIMEOUT, abort)
+    watchdog.daemon = True
+    watchdog.start()
+    search_organisms.main()
+    # All the islands must be done
+    comm.Barrier()
+    watchdog.cancel()
+    if rank == 0:
+        print("{} islands finished after {} to {} generations: OK".format(
+            comm.Get_size(), CHECK_ITERATIONS,
+            CHECK_ITERATIONS + CHECK_ITERATIONS_STEP * (comm.Get_size() - 1)))
+
+
+if __name__ == "__main__":
+
+    main()
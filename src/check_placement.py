@@ -0,0 +1,291 @@
+# -*- coding: utf-8 -*-
+"""Equivalence checks of the placement engines
+
+Organisms are generated by the OrganismFactory, and sequences at random, from
+a fixed seed (CHECK_SEED). Every placement path is compared with the
+reference implementation (OrganismObject.get_reference_placement):
+    - energies: vectorized engine (full and banded gap evaluation), tracks
+      engine, batched placement of sequence blocks (get_binding_energies) and
+      population engine. With the approximate gap evaluation, energies must
+      be within the error bound below the reference ones (never above)
+    - traceback: positions, strands and node scores of the placements of the
+      vectorized engine
+    - checkpoints: energies of mutated clones, resumed from the placement
+      checkpoints of their parent on chunks of the sequences (as in the early
+      abort evaluation), and whether any placement was actually resumed
+All the checks are run on organisms scanning the forward strand only, and on
+organisms scanning both strands (SCAN_REVERSE_COMPLEMENT). One organism in
+three gets connectors with mu = 0, so that 0-bp gaps are frequent. Sequence
+lengths alternate between longer and shorter ones, so that the buffers of the
+arena are both grown and reused.
+
+The energy thresholds are disabled (the raw scores are compared), and the
+placement cache is not used. Mismatches are printed; the exit status is 1 if
+there is any.
+
+"""
+
+import os
+import sys
+import random
+import numpy as np
+from search_organisms import read_json_file, split_sequence_block
+from objects.organism_factory import OrganismFactory
+from objects.sequence_block_object import SequenceBlockObject
+from objects.pssm_object import BASES
+from objects.metrics_object import metrics
+from objects import population_engine
+
+CONFIG_FILE = "config.json"
+
+CHECK_SEED = 1
+CHECK_ORGANISMS = 30
+CHECK_SEQUENCES = 4
+CHECK_SEQUENCE_LENGTHS = [40, 12, 90, 25]
+# Sequences per chunk in the checkpoint checks
+CHECK_CHUNK_SIZE = 2
+# Relative tolerance on the scores (the tracks engine adds up the PSSM
+# columns in a different order, and the node scores are differences)
+TOLERANCE = 1e-9
+
+# (PLACEMENT_ENGINE, GAP_EVALUATION) pairs compared with the reference
+ENGINES = [("vectorized", "full"), ("vectorized", "banded"),
+           ("tracks", "banded")]
+
+
+def set_seed(seed: int) -> None:
+    """Seeds the random generators used by the factory and the mutations.
+    """
+    random.seed(seed)
+    np.random.seed(seed)
+
+
+def get_random_sequences(number: int, length: int, rng) -> list:
+    """Returns a list of random DNA sequences (lowercase strings).
+    """
+    bases = np.array(BASES)
+    return ["".join(bases[rng.randint(0, 4, length)]) for _ in range(number)]
+
+
+def is_close(a, b) -> bool:
+    """Whether two scores are equal, up to TOLERANCE (infinite scores must be
+       equal).
+    """
+    if a == b:
+        return True
+    if not (np.isfinite(a) and np.isfinite(b)):
+        return False
+    return abs(a - b) <= TOLERANCE * max(1.0, abs(a), abs(b))
+
+
+def is_within_bound(expected, energy, bound) -> bool:
+    """Whether an approximate score is not higher than the exact one, and
+       lower by at most bound (up to TOLERANCE).
+    """
+    if is_close(expected, energy):
+        return True
+    if not (np.isfinite(expected) and np.isfinite(energy)):
+        return False
+    slack = TOLERANCE * max(1.0, abs(expected))
+    return expected - bound - slack <= energy <= expected + slack
+
+
+def set_engine(org, engine: str, gap_evaluation: str) -> None:
+    """Selects the placement engine of an organism.
+    """
+    org.placement_engine = engine
+    org.gap_evaluation = gap_evaluation
+
+
+def get_check_organisms(factory, number: int) -> list:
+    """Returns random organisms, with the energy threshold disabled. One in
+       three gets connectors with mu = 0 (frequent 0-bp gaps).
+    """
+    organisms = []
+    for i in range(number):
+        org = factory.get_organism()
+        if i % 3 == 0:
+            for connector in org.connectors:
+                connector.set_mu(0)
+        org.energy_threshold_method = "organism"
+        org.energy_threshold_value = -1 * np.inf
+        org.placement_cache_size = 0
+        org.max_placement_checkpoints = 0
+        organisms.append(org)
+    return organisms
+
+
+def check_energies(organisms: list, sequences: dict) -> list:
+    """Compares the energies of all the engines with the reference ones.
+       sequences maps each length to the sequences of that length.
+    """
+    failures = []
+    references = {}
+    for org in organisms:
+        for length, group in sequences.items():
+            references[org._id, length] = [
+                org.get_reference_placement(s).energy for s in group]
+
+    for org in organisms:
+        for engine, gap_evaluation in ENGINES:
+            set_engine(org, engine, gap_evaluation)
+            for length, group in sequences.items():
+                reference = references[org._id, length]
+                single = [org.get_placement(s).energy for s in group]
+                block = org.get_binding_energies(SequenceBlockObject(group))
+                for name, energies in [("placement", single), ("block", block)]:
+                    for s, (expected, energy) in enumerate(zip(reference,
+                                                               energies)):
+                        if not is_close(expected, energy):
+                            failures.append(
+                                "energy org {} {}/{} {} seq {}x{}: {} != {}".format(
+                                    org._id, engine, gap_evaluation, name,
+                                    length, s, energy, expected))
+        # Approximate gap evaluation: never above the reference, and below it
+        # by at most the error bound
+        for engine in ["vectorized", "tracks"]:
+            set_engine(org, engine, "approximate")
+            for length, group in sequences.items():
+                block = org.get_binding_energies(SequenceBlockObject(group))
+                bound = org.energy_error_bound
+                for s, (expected, energy) in enumerate(zip(
+                        references[org._id, length], block)):
+                    if not is_within_bound(expected, energy, bound):
+                        failures.append(
+                            "energy org {} {}/approximate seq {}x{}: {} "
+                            "not within {} below {}".format(
+                                org._id, engine, length, s, energy, bound,
+                                expected))
+        set_engine(org, "vectorized", "banded")
+
+    # Whole population at once (several batches)
+    for length, group in sequences.items():
+        population = population_engine.get_population_energies(
+            organisms, SequenceBlockObject(group), 7)
+        for org, energies in zip(organisms, population):
+            for s, (expected, energy) in enumerate(zip(
+                    references[org._id, length], energies)):
+                if not is_close(expected, energy):
+                    failures.append(
+                        "energy org {} population seq {}x{}: {} != {}".format(
+                            org._id, length, s, energy, expected))
+    return failures
+
+
+def check_tracebacks(organisms: list, sequences: dict) -> list:
+    """Compares the placements (with traceback) of the vectorized engine with
+       the reference ones.
+    """
+    failures = []
+    for org in organisms:
+        set_engine(org, "vectorized", "banded")
+        for length, group in sequences.items():
+            for s, dna_sequence in enumerate(group):
+                expected = org.get_reference_placement(dna_sequence,
+                                                       traceback=True)
+                placement = org.get_placement(dna_sequence, traceback=True)
+                if expected.energy == -1 * np.inf:
+                    continue
+                differences = []
+                for feature in ["recognizers_positions", "connectors_positions"]:
+                    if getattr(expected, feature) != getattr(placement, feature):
+                        differences.append(feature)
+                # The forward-only reference doesn't compile the strands
+                if (len(expected.recognizers_strands) > 0 and
+                        expected.recognizers_strands != placement.recognizers_strands):
+                    differences.append("recognizers_strands")
+                for feature in ["recognizers_scores", "connectors_scores"]:
+                    scores = getattr(placement, feature)
+                    expected_scores = getattr(expected, feature)
+                    if len(scores) != len(expected_scores) or not all(
+                            is_close(a, b) for a, b in zip(scores,
+                                                           expected_scores)):
+                        differences.append(feature)
+                if differences:
+                    failures.append("traceback org {} seq {}x{}: {}".format(
+                        org._id, length, s, ", ".join(differences)))
+    return failures
+
+
+def check_checkpoints(factory, organisms: list, sequences: dict) -> list:
+    """Places mutated clones of the organisms, resuming from the placement
+       checkpoints of their parent, and compares their energies with the
+       reference ones. As in the early abort evaluation, the sequences are
+       split into chunks, and the parent and the child are placed on
+       different blocks with the same content.
+    """
+    failures = []
+    resumes = metrics.counters["checkpoint_resumes"]
+    for org in organisms:
+        org.max_placement_checkpoints = 2 * len(sequences)
+        for group in sequences.values():
+            for chunk in split_sequence_block(SequenceBlockObject(group),
+                                              CHECK_CHUNK_SIZE):
+                org.get_binding_energies(chunk)
+        child, _ = factory.clone_parents(org, org)
+        child.mutate(factory)
+        for length, group in sequences.items():
+            chunks = split_sequence_block(SequenceBlockObject(group),
+                                          CHECK_CHUNK_SIZE)
+            energies = [energy for chunk in chunks
+                        for energy in child.get_binding_energies(chunk)]
+            expected = [child.get_reference_placement(s).energy
+                        for s in sequences[length]]
+            for s, (expected_energy, energy) in enumerate(zip(expected,
+                                                              energies)):
+                if not is_close(expected_energy, energy):
+                    failures.append(
+                        "checkpoint org {} seq {}x{}: {} != {}".format(
+                            org._id, length, s, energy, expected_energy))
+        org.max_placement_checkpoints = 0
+    if metrics.counters["checkpoint_resumes"] == resumes:
+        failures.append("checkpoint: no placement was resumed")
+    return failures
+
+
+def main():
+    """Main execution for the equivalence checks
+
+    """
+    #read configuration file
+    config = read_json_file(CONFIG_FILE)
+    conf_org = dict(config["organism"])
+    conf_org["PLACEMENT_CACHE_SIZE"] = 0
+    conf_pssm_strands = dict(config["pssm"])
+    conf_pssm_strands["SCAN_REVERSE_COMPLEMENT"] = True
+
+    # Counters of the checkpoint resumes (nothing is written)
+    metrics.enable(os.devnull, "jsonl")
+
+    rng = np.random.RandomState(CHECK_SEED)
+    sequences = {length: get_random_sequences(CHECK_SEQUENCES, length, rng)
+                 for length in CHECK_SEQUENCE_LENGTHS}
+
+    failures = []
+    for strand_mode, conf_pssm in [("forward", config["pssm"]),
+                                   ("both strands", conf_pssm_strands)]:
+        set_seed(CHECK_SEED)
+        factory = OrganismFactory(conf_org, config["organismFactory"],
+                                  config["connector"], conf_pssm, None)
+        organisms = get_check_organisms(factory, CHECK_ORGANISMS)
+        checks = [("energies", check_energies(organisms, sequences)),
+                  ("tracebacks", check_tracebacks(organisms, sequences)),
+                  ("checkpoints", check_checkpoints(factory, organisms,
+                                                    sequences))]
+        for name, check_failures in checks:
+            print("{:<13} {:<11} {}".format(
+                strand_mode, name,
+                "OK" if not check_failures else
+                "{} mismatches".format(len(check_failures))))
+            failures += check_failures
+
+    metrics.close()
+    for failure in failures:
+        print(failure)
+    if failures:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+
+    main()
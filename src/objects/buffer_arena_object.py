@@ -0,0 +1,53 @@
+# -*- coding: utf-8 -*-
+"""
+Buffer arena object
+Scratch arrays of the placement engine, reused across placements.
+
+"""
+
+import threading
+import numpy as np
+
+class BufferArenaObject(threading.local):
+    """
+    Buffer arena object
+
+    Keeps one flat buffer for each name and dtype, and returns views of it
+    with the requested shape. A buffer is only reallocated when a larger
+    shape is requested (its capacity is at least doubled), so after the first
+    placements on the longest sequences no more memory is allocated.
+    The arena is thread-local: each thread gets its own buffers.
+    The content of a view is undefined, and it is only valid until the same
+    buffer is requested again: views must never be stored.
+
+    """
+
+    def __init__(self):
+        """
+        BufferArenaObject object constructor.
+        """
+
+        self.buffers = {}
+
+    def get(self, name: str, shape: tuple, dtype=float) -> np.ndarray:
+        """Returns an uninitialized array of the given shape, backed by the
+           buffer of the given name and dtype.
+        """
+        size = int(np.prod(shape))
+        key = (name, np.dtype(dtype))
+        buffer = self.buffers.get(key)
+        if buffer is None or buffer.size < size:
+            capacity = size if buffer is None else max(size, 2 * buffer.size)
+            buffer = np.empty(capacity, dtype=dtype)
+            self.buffers[key] = buffer
+        return buffer[:size].reshape(shape)
+
+    def get_size(self) -> int:
+        """Returns the number of bytes held by the buffers of this thread.
+        """
+        return sum(buffer.nbytes for buffer in self.buffers.values())
+
+    def clear(self) -> None:
+        """Frees the buffers of this thread.
+        """
+        self.buffers = {}
@@ -11,6 +11,7 @@
 import random
 import numpy as np
 import math
+from .metrics_object import metrics
 
 
 def norm_cdf(x, mu, sigma):
@@ -95,8 +96,22 @@ class ConnectorObject():
         # precompute connector energies for expected length range
         self.stored_pdfs = []
         self.stored_cdfs = []
+        # memoized score tables (see get_score_table)
+        self.score_tables = {}
         self.set_precomputed_pdfs_cdfs()
     
+    def clone(self):
+        """Returns a copy of the connector. The configuration values, the
+           precomputed PDFs and CDFs and the memoized score tables (arrays)
+           are shared with the original until mu or sigma change (they are
+           replaced, not modified, by set_precomputed_pdfs_cdfs). The dict of
+           the score tables is the clone's own.
+        """
+        new_connector = ConnectorObject.__new__(ConnectorObject)
+        new_connector.__dict__.update(self.__dict__)
+        new_connector.score_tables = dict(self.score_tables)
+        return new_connector
+    
     # Setters
     def set_mu(self, _mu: int) -> None:
         """Set mu variable
@@ -105,6 +120,7 @@ class ConnectorObject():
             _mu: Mean distance between nodes connected by connector
         """
         self._mu = _mu
+        self.set_precomputed_pdfs_cdfs()
 
     def set_sigma(self, sigma: int) -> None:
         """Set sigma variable
@@ -114,14 +130,18 @@ class ConnectorObject():
             by connector
         """
         self._sigma = sigma
+        self.set_precomputed_pdfs_cdfs()
     
     def set_precomputed_pdfs_cdfs(self) -> None:
-        """Set stored_pdfs variable and stored_cdfs variable
+        """Set stored_pdfs variable and stored_cdfs variable.
+           The memoized score tables depend on mu and sigma too, so they are
+           discarded.
         """
         
         # Delete previous values
         self.stored_pdfs = []
         self.stored_cdfs = []
+        self.score_tables = {}
         
         # Compute new values
         for dist in range(self.expected_seq_length):
@@ -145,6 +165,8 @@ class ConnectorObject():
             org_factory(organism_factory): Organism Facory
         """
         
+        previous_parameters = (self._mu, self._sigma)
+        
         # SIGMA MUTATION
         if random.random() < self.mutate_probability_sigma:
             #determine type of mutation (linear or log)
@@ -183,8 +205,10 @@ class ConnectorObject():
             elif self.mu_mutator=="standard":
                 self._mu = abs(random.gauss(self._mu, self._sigma))
         
-        # Recompute PDF and CDF values
-        self.set_precomputed_pdfs_cdfs()
+        # Recompute PDF and CDF values (only if the parameters changed: the
+        # current ones may be shared with clones of the connector)
+        if (self._mu, self._sigma) != previous_parameters:
+            self.set_precomputed_pdfs_cdfs()
     
     
     # !!! New null model function
@@ -268,6 +292,54 @@ class ConnectorObject():
         
         return e_connector
 
+    def get_score_table(self, s_dna_len, recog_sizes) -> np.ndarray:
+        """ Returns the scores of the connector for all the distances that can
+            be observed on a DNA sequence of length s_dna_len.
+            Parameters
+            ----------
+            s_dna_len : length of DNA sequence on which connector is placed
+            recog_sizes : tuple with the lengths of the recognizers of the
+                          organism
+    
+            Returns
+            -------
+            score_table : array of length s_dna_len + 1. Element d is the
+                          score returned by get_score for a distance d, and
+                          the last element (d = s_dna_len, a gap that doesn't
+                          fit the sequence) is -inf.
+            
+            Tables are memoized by (s_dna_len, recog_sizes). They are discarded
+            when mu or sigma change (see set_precomputed_pdfs_cdfs), and a
+            change in the recognizers' lengths gives a different key.
+            Tables for recognizer sizes other than the current ones will
+            never be used again, so they are discarded too. The dict of the
+            tables is replaced, never modified, so it can be read while
+            another thread (e.g. the exporter) adds a table.
+        """
+        key = (s_dna_len, tuple(recog_sizes))
+        score_table = self.score_tables.get(key)
+        if score_table is not None:
+            metrics.count("connector_table_hits")
+        else:
+            metrics.count("connector_table_misses")
+            score_tables = self.score_tables
+            if any(k[1] != key[1] for k in score_tables):
+                score_tables = {}
+            
+            score_table = np.full(s_dna_len + 1, -1 * np.inf)
+            for d in range(s_dna_len):
+                score_table[d] = self.get_score(d, s_dna_len, recog_sizes)
+            score_tables = dict(score_tables)
+            score_tables[key] = score_table
+            self.score_tables = score_tables
+        
+        return score_table
+
+    def get_signature(self) -> tuple:
+        """Returns a tuple with the parameters the connector scores depend on.
+        """
+        return (self._mu, self._sigma)
+
     def print(self) -> None:
         """Prints the connector mu and sigma values
         """
@@ -0,0 +1,80 @@
+# -*- coding: utf-8 -*-
+"""
+Dataset object
+A set of DNA sequences, encoded once and stored in one contiguous buffer.
+
+"""
+
+from collections.abc import Sequence
+import numpy as np
+from .placement_engine import BASES, encode_sequence
+
+class DatasetObject(Sequence):
+    """
+    Dataset object
+
+    All the sequences are encoded as base indexes (following the BASES order
+    of the placement engine) and concatenated in one uint8 buffer. An offsets
+    table gives where each sequence starts and ends. The reverse complement
+    strand is not stored: the placement engine scans it with the reverse
+    complement PSSMs, on the forward codes.
+
+    The order of the sequences is an index array over the buffer: slicing and
+    shuffling return views that share the buffer with the original dataset
+    (no sequence is copied). Indexing with an integer returns the sequence as
+    a string, so the object can be used wherever a list of sequences was used.
+
+    """
+
+    def __init__(self, dna_sequences):
+        """
+        DatasetObject object constructor.
+
+        Args:
+            dna_sequences: list of DNA sequences (lowercase strings)
+        """
+
+        lengths = np.array([len(s) for s in dna_sequences], dtype=int)
+        self.offsets = np.zeros(len(dna_sequences) + 1, dtype=int)
+        self.offsets[1:] = np.cumsum(lengths)
+
+        # Encoded sequences, one after the other
+        self.buffer = encode_sequence("".join(dna_sequences))
+
+        # Indexes of the sequences in the buffer, in the dataset order
+        self.order = np.arange(len(dna_sequences))
+
+    def get_view(self, order):
+        """Returns a dataset with the sequences of this dataset in the given
+           order (list or array of indexes into this dataset). The buffer
+           is shared, not copied.
+        """
+        view = DatasetObject.__new__(DatasetObject)
+        view.offsets = self.offsets
+        view.buffer = self.buffer
+        view.order = self.order[np.asarray(order, dtype=int)]
+        return view
+
+    def __len__(self):
+        return len(self.order)
+
+    def __getitem__(self, idx):
+        """Slices return a view of the dataset; integers return the sequence
+           as a string.
+        """
+        if isinstance(idx, slice):
+            return self.get_view(np.arange(len(self.order))[idx])
+        return "".join([BASES[b] for b in self.get_codes(idx)])
+
+    def get_length(self, idx) -> int:
+        """Returns the length of a sequence.
+        """
+        seq = self.order[idx]
+        return int(self.offsets[seq + 1] - self.offsets[seq])
+
+    def get_codes(self, idx) -> np.ndarray:
+        """Returns the encoded sequence (a view on the buffer).
+        """
+        seq = self.order[idx]
+        return self.buffer[self.offsets[seq]:self.offsets[seq + 1]]
+
@@ -0,0 +1,68 @@
+# -*- coding: utf-8 -*-
+"""
+Fitness cache object
+
+"""
+
+import threading
+from collections import OrderedDict
+from .metrics_object import metrics
+
+class FitnessCacheObject:
+    """
+    Fitness cache object
+
+    Least-recently-used cache of fitness values. Keys are built by the caller
+    and must identify everything the fitness depends on: the genome of the
+    organism (see OrganismObject.get_genome_hash), the fitness function and
+    the sample of the datasets it was computed on. The cache can be shared
+    by several threads.
+
+    """
+
+    def __init__(self, max_size):
+        """
+        FitnessCacheObject object constructor.
+
+        Args:
+            max_size: maximum number of fitness values stored. When the cache
+                      is full, the least recently used value is discarded
+        """
+
+        self.max_size = max_size
+        self.values = OrderedDict()
+        self.lock = threading.Lock()
+
+        # Statistics
+        self.hits = 0
+        self.misses = 0
+
+    def get(self, key):
+        """Returns the fitness stored for the key, or None if there is none.
+        """
+        with self.lock:
+            fitness = self.values.get(key)
+            if fitness is not None:
+                self.values.move_to_end(key)
+                self.hits += 1
+            else:
+                self.misses += 1
+        metrics.count("fitness_cache_misses" if fitness is None
+                      else "fitness_cache_hits")
+        return fitness
+
+    def set(self, key, fitness) -> None:
+        """Stores the fitness for the key.
+        """
+        with self.lock:
+            self.values[key] = fitness
+            self.values.move_to_end(key)
+            while len(self.values) > self.max_size:
+                self.values.popitem(last=False)
+
+    def clear(self) -> None:
+        """Discards all the stored values.
+        """
+        with self.lock:
+            self.values = OrderedDict()
+
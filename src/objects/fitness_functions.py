@@ -0,0 +1,106 @@
+# -*- coding: utf-8 -*-
+"""
+Fitness functions
+Scores of an organism computed from its binding energies on the positive and
+negative samples.
+
+The energies are the arrays returned by the batched placement (see
+OrganismObject.get_binding_energies): every function works on whole arrays,
+with no loop over the sequences. The Boltzmannian fitness is computed in log
+space, so that it doesn't overflow for large energies.
+"""
+
+import numpy as np
+from scipy.stats import ks_2samp
+
+
+def log_sum_exp(values: np.ndarray) -> float:
+    """Returns log(sum(exp(values))), without overflowing. It's -inf if the
+       array is empty or all the values are -inf.
+    """
+    if values.size == 0:
+        return -1 * np.inf
+    top = values.max()
+    if top == -1 * np.inf:
+        return -1 * np.inf
+    if top == np.inf:
+        return np.inf
+    return float(top + np.log(np.exp(values - top).sum()))
+
+
+def get_additive_score(energies, method: str) -> tuple:
+    """Returns the cumulative energy (sum, mean or median, depending on
+       method: CUMULATIVE_FIT_METHOD) and the standard deviation of the
+       energies.
+    """
+    energies = np.asarray(energies, dtype=float)
+    if method == "sum":
+        score = energies.sum()
+    elif method == "mean":
+        score = energies.mean()
+    elif method == "median":
+        score = np.median(energies)
+    else:
+        raise ValueError('CUMULATIVE_FIT_METHOD should be "sum", "mean" or '
+                         '"median".')
+    return float(score), float(energies.std())
+
+
+def get_discriminative_score(pos_energies, neg_energies, method: str) -> float:
+    """Returns the difference between the cumulative energies on the positive
+       and on the negative sample.
+    """
+    return (get_additive_score(pos_energies, method)[0]
+            - get_additive_score(neg_energies, method)[0])
+
+
+def get_welchs_score(pos_energies, neg_energies, method: str, n_pos: int,
+                     n_neg: int) -> float:
+    """Returns Welch's t score of the difference between the cumulative
+       energies on the positive and on the negative sample. The standard
+       deviations have lower bound 1 (being more consistent than that on the
+       samples doesn't help the fitness), and the standard errors are taken
+       for samples of n_pos and n_neg sequences (MAX_SEQUENCES_TO_FIT_POS and
+       MAX_SEQUENCES_TO_FIT_NEG).
+    """
+    p_1, sigma_p_1 = get_additive_score(pos_energies, method)
+    n_1, sigma_n_1 = get_additive_score(neg_energies, method)
+
+    # Standard errors
+    sterr_p_1 = max(sigma_p_1, 1) / n_pos**(1/2)
+    sterr_n_1 = max(sigma_n_1, 1) / n_neg**(1/2)
+
+    return (p_1 - n_1) / (sterr_p_1**2 + sterr_n_1**2)**(1/2)
+
+
+def get_kolmogorov_score(pos_energies, neg_energies) -> float:
+    """Returns the Kolmogorov-Smirnov statistic of the positive and negative
+       energies, in [0, 1].
+    """
+    return float(ks_2samp(np.asarray(pos_energies, dtype=float),
+                          np.asarray(neg_energies, dtype=float)).statistic)
+
+
+def get_boltzmann_score(pos_energies, neg_energies, neg_factor: float) -> float:
+    """Returns the probability that the regulator binds a positive sequence,
+       when each sequence is bound with probability exp(energy) / Z and the
+       negative sample is weighted by neg_factor (see
+       OrganismObject.get_boltz_fitness).
+       Computed in log space:
+           log(P) = LSE(pos) - log(exp(LSE(pos)) + neg_factor * exp(LSE(neg)))
+       where LSE is log_sum_exp.
+    """
+    log_pos = log_sum_exp(np.asarray(pos_energies, dtype=float))
+    log_neg = log_sum_exp(np.asarray(neg_energies, dtype=float))
+    if neg_factor > 0:
+        log_neg = log_neg + np.log(neg_factor)
+    else:
+        log_neg = -1 * np.inf
+    log_z = np.logaddexp(log_pos, log_neg)
+    if log_z == -1 * np.inf:
+        # No sequence can be bound
+        return 0.0
+    if log_pos == np.inf:
+        # The positive sample takes all the probability
+        return 1.0 if log_neg < np.inf else 0.5
+    return float(np.exp(log_pos - log_z))
@@ -0,0 +1,187 @@
+# -*- coding: utf-8 -*-
+"""
+Island migration object
+Asynchronous exchanges between the islands of an island-model run.
+
+"""
+
+from . import mpi_transport
+
+# Tags of the MPI messages (TASK_TAG = 1 is used by the tasks protocol)
+MIGRATION_TAG = 2
+SUMMARY_TAG = 3
+
+class IslandMigrationObject:
+    """
+    Island migration object
+
+    With the islands protocol each MPI process evolves its own population,
+    and the processes never wait for each other during the run. Every
+    interval generations, each island:
+        - sends copies of its best organisms (as compact genomes) to the next
+          island of a ring (rank + 1)
+        - sends a summary of its best organism to process 0, which keeps the
+          best organism of the whole run
+    All the messages are sent with non-blocking sends, and received only when
+    they have already arrived (the receiving island probes for them).
+    Migrants replace the worst organisms of the island, if they're fitter.
+    Each island samples its own sequences, so the migrants are evaluated
+    again by the receiving island, on its current sample, before they're
+    compared with its organisms.
+
+    """
+
+    def __init__(self, comm, mpi, factory, interval, n_migrants):
+        """
+        IslandMigrationObject object constructor.
+
+        Args:
+            comm: MPI communicator of the islands
+            mpi: the mpi4py MPI module
+            factory: OrganismFactory used to rebuild the migrants
+            interval: number of generations between two exchanges
+            n_migrants: number of organisms sent at each exchange
+        """
+
+        self.comm = comm
+        self.mpi = mpi
+        self.factory = factory
+        self.interval = interval
+        self.n_migrants = n_migrants
+        self.rank = comm.Get_rank()
+        self.size = comm.Get_size()
+
+        # Neighbours in the ring of islands
+        self.right = (self.rank + 1) % self.size
+        self.left = (self.rank - 1) % self.size
+
+        # Sends not completed yet, and number of messages sent to (by
+        # destination) and received from the other islands (see finish)
+        self.requests = []
+        self.sent_counts = [0] * self.size
+        self.received = 0
+
+    @staticmethod
+    def get_evaluated(population_fitness) -> list:
+        """Returns the indexes of the organisms whose fitness is known.
+        """
+        return [i for i, fitness in enumerate(population_fitness)
+                if fitness is not None]
+
+    def send(self, message, dest, tag) -> None:
+        """Non-blocking send of a message to another island.
+        """
+        request = mpi_transport.isend(self.comm, message, dest, tag)
+        self.requests.append(request)
+        self.sent_counts[dest] += 1
+        # Forget the sends that have been completed
+        self.requests = [request for request in self.requests
+                         if not request.Test()]
+
+    def exchange(self, iterations, population, population_fitness,
+                 best_organism, get_fitness) -> tuple:
+        """Sends migrants and summaries (every interval generations) and
+           handles the messages that have arrived.
+
+        Args:
+            iterations: generation counter
+            population: organisms of the island (migrants are placed there)
+            population_fitness: fitness of each organism of the population
+                                (updated for the migrants). It's None for
+                                the organisms that were not evaluated in the
+                                generation: they are neither sent nor
+                                replaced
+            best_organism: (organism, fitness, nodes) best organism known by
+                           this island
+            get_fitness: function returning the fitness of an organism on
+                         the current sample of the island (used to evaluate
+                         the migrants received)
+
+        Returns:
+            the best organism known by this island, and whether it changed.
+            On process 0 it's the best of all the summaries received
+        """
+        changed = False
+        if self.size > 1 and iterations % self.interval == 0:
+            if self.n_migrants > 0:
+                ranking = sorted(self.get_evaluated(population_fitness),
+                                 key=lambda i: population_fitness[i],
+                                 reverse=True)
+                migrants = [self.factory.get_compact_genome(population[i])
+                            for i in ranking[:self.n_migrants]]
+                self.send(migrants, self.right, MIGRATION_TAG)
+            if self.rank != 0 and best_organism[0] is not None:
+                summary = (self.factory.get_compact_genome(best_organism[0]),
+                           best_organism[1], best_organism[2], iterations)
+                self.send(summary, 0, SUMMARY_TAG)
+
+        # Migrants arrived from the previous island
+        while self.comm.Iprobe(source=self.left, tag=MIGRATION_TAG):
+            migrants = mpi_transport.recv(self.comm, self.left, MIGRATION_TAG)
+            self.received += 1
+            self.place_migrants(migrants, population, population_fitness,
+                                get_fitness)
+
+        # Summaries of the other islands
+        if self.rank == 0:
+            while self.comm.Iprobe(source=self.mpi.ANY_SOURCE, tag=SUMMARY_TAG):
+                summary = mpi_transport.recv(self.comm, self.mpi.ANY_SOURCE,
+                                             SUMMARY_TAG)
+                self.received += 1
+                best_organism, improved = self.update_best(best_organism,
+                                                           summary)
+                changed = changed or improved
+        return best_organism, changed
+
+    def place_migrants(self, migrants, population, population_fitness,
+                       get_fitness) -> None:
+        """Each migrant replaces one of the worst (evaluated) organisms of the
+           island, if it's fitter on the sample of the island. Migrants get a
+           new ID (the original one is kept by the organism on the island of
+           origin).
+        """
+        ranking = sorted(self.get_evaluated(population_fitness),
+                         key=lambda i: population_fitness[i])
+        for genome, i in zip(migrants, ranking):
+            migrant = self.factory.get_organism_from_compact_genome(genome)
+            fitness = get_fitness(migrant)
+            if fitness > population_fitness[i]:
+                migrant.set_id(self.factory.get_id())
+                population[i] = migrant
+                population_fitness[i] = fitness
+
+    def update_best(self, best_organism, summary) -> tuple:
+        """Returns the best between best_organism and the organism of a
+           summary, and whether it's the one of the summary. The fitness
+           values are the ones computed by each island, on its own sample:
+           the best organism of the run is the one with the best fitness on
+           the sample of its island.
+        """
+        genome, fitness, nodes, _ = summary
+        if fitness > best_organism[1]:
+            organism = self.factory.get_organism_from_compact_genome(genome)
+            return (organism, fitness, nodes), True
+        return best_organism, False
+
+    def finish(self, best_organism) -> tuple:
+        """Ends the exchanges. It must be called by all the processes, when
+           their run is over: the messages still in flight are received
+           (migrants are discarded, summaries are still taken into account
+           by process 0) and the pending sends are completed.
+
+        Returns:
+            the best organism known by this island (see exchange)
+        """
+        all_sent_counts = mpi_transport.collective(self.comm.allgather,
+                                                   self.sent_counts)
+        expected = sum(counts[self.rank] for counts in all_sent_counts)
+        while self.received < expected:
+            status = self.mpi.Status()
+            message = mpi_transport.recv(self.comm, self.mpi.ANY_SOURCE,
+                                         self.mpi.ANY_TAG, status)
+            self.received += 1
+            if status.Get_tag() == SUMMARY_TAG:
+                best_organism, _ = self.update_best(best_organism, message)
+        self.mpi.Request.waitall(self.requests)
+        self.requests = []
+        return best_organism
@@ -0,0 +1,162 @@
+# -*- coding: utf-8 -*-
+"""
+Metrics object
+Counters and timers of the hot paths, written once per generation.
+
+"""
+
+import json
+import time
+import threading
+
+# Counters and timers written in each record (in this order, for CSV files)
+COUNTERS = [
+    "placements",  # sequences placed (batched placements)
+    "dp_cells",  # placement matrix cells (positions x PSSM columns)
+    "gap_passes",  # horizontal moves evaluated at a recognizer interface
+    "gap_exact_columns",  # cells evaluated on all the gap sizes (banded)
+    "connector_table_hits",
+    "connector_table_misses",
+    "placement_cache_hits",
+    "placement_cache_misses",
+    "checkpoint_resumes",  # batched placements resumed from a checkpoint
+    "track_store_hits",
+    "track_store_misses",
+    "fitness_cache_hits",
+    "fitness_cache_misses",
+    "mpi_bytes",  # serialized size of the data sent (collectives and messages)
+]
+TIMERS = [
+    "generation_time",
+    "recombination_time",
+    "mutation_time",
+    "evaluation_time",
+    "mpi_wait_time",
+    "export_time",  # spent by the main thread submitting exports
+    "background_export_time",  # spent by the exporter thread
+    "checkpoint_time",
+]
+
+class Timer:
+    """Context manager adding the time spent in its block to a timer of a
+       MetricsObject.
+    """
+
+    def __init__(self, metrics, name):
+        self.metrics = metrics
+        self.name = name
+        self.start = 0.0
+
+    def __enter__(self):
+        self.start = time.perf_counter()
+        return self
+
+    def __exit__(self, *exc_info):
+        self.metrics.add_time(self.name, time.perf_counter() - self.start)
+        return False
+
+
+class NullTimer:
+    """Context manager doing nothing (timers of disabled metrics).
+    """
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc_info):
+        return False
+
+
+NULL_TIMER = NullTimer()
+
+class MetricsObject:
+    """
+    Metrics object
+
+    Counters and timers are accumulated during a generation, and written as
+    one record (a JSON line or a CSV row) by emit, which resets them. When
+    the metrics are disabled every call returns immediately, so the
+    instrumentation can be left in the hot paths. Counters and timers can be
+    updated by all the threads evaluating the competitions (NUM_THREADS): the
+    timers inside the evaluation add up the time of all the threads. The
+    exporter thread measures its own time (see ResultExporterObject).
+
+    """
+
+    def __init__(self):
+        """
+        MetricsObject object constructor. Metrics start disabled (see
+        enable).
+        """
+
+        self.enabled = False
+        self.output_format = None
+        self.output_file = None
+        self.counters = dict.fromkeys(COUNTERS, 0)
+        self.timers = dict.fromkeys(TIMERS, 0.0)
+        self.lock = threading.Lock()
+
+    def enable(self, filename: str, output_format: str) -> None:
+        """Starts collecting metrics, written to filename (one record per
+           generation) as "jsonl" or "csv" (output_format).
+        """
+        if output_format not in ["jsonl", "csv"]:
+            raise ValueError('METRICS_FORMAT should be "jsonl" or "csv".')
+        self.enabled = True
+        self.output_format = output_format
+        self.output_file = open(filename, "w")
+        if output_format == "csv":
+            self.output_file.write(
+                ",".join(["iteration", "rank"] + COUNTERS + TIMERS) + "\n")
+
+    def count(self, name: str, value=1) -> None:
+        """Adds value to a counter.
+        """
+        if self.enabled:
+            with self.lock:
+                self.counters[name] += value
+
+    def timer(self, name: str):
+        """Returns a context manager adding the time spent in its block to a
+           timer.
+        """
+        if self.enabled:
+            return Timer(self, name)
+        return NULL_TIMER
+
+    def add_time(self, name: str, seconds: float) -> None:
+        """Adds seconds to a timer.
+        """
+        if self.enabled:
+            with self.lock:
+                self.timers[name] += seconds
+
+    def emit(self, iteration: int, rank) -> None:
+        """Writes the record of a generation, and resets the metrics.
+        """
+        if not self.enabled:
+            return
+        if self.output_format == "jsonl":
+            record = {"iteration": iteration, "rank": rank}
+            record.update(self.counters)
+            record.update(self.timers)
+            self.output_file.write(json.dumps(record) + "\n")
+        else:
+            values = ([iteration, rank] + [self.counters[c] for c in COUNTERS]
+                      + ["{:.6f}".format(self.timers[t]) for t in TIMERS])
+            self.output_file.write(",".join([str(v) for v in values]) + "\n")
+        self.output_file.flush()
+        self.counters = dict.fromkeys(COUNTERS, 0)
+        self.timers = dict.fromkeys(TIMERS, 0.0)
+
+    def close(self) -> None:
+        """Stops collecting metrics, and closes the output file.
+        """
+        if self.output_file is not None:
+            self.output_file.close()
+            self.output_file = None
+        self.enabled = False
+
+
+# Metrics of the process, shared by all the modules
+metrics = MetricsObject()
@@ -0,0 +1,96 @@
+# -*- coding: utf-8 -*-
+"""
+MPI transport
+Instrumented MPI communication: collective operations and point-to-point
+messages, with the bytes sent and the time spent waiting recorded in the
+metrics (mpi_bytes, mpi_wait_time).
+
+All the messages of the run go through these functions. With metrics
+disabled they call mpi4py directly. With metrics enabled, each payload is
+pickled once, here: its size is counted, and the bytes are sent (mpi4py only
+copies a bytes object, it doesn't traverse it again). The receivers unpickle
+the bytes. Both sides of an operation must agree on whether metrics are
+enabled (they always do: METRICS is a setting of the run).
+"""
+
+import pickle
+from .metrics_object import metrics
+
+# Collective operations, by how the payload of each process is sent:
+# one object, or one object for each process
+SINGLE_PAYLOAD_OPERATIONS = ["bcast", "gather", "allgather"]
+LIST_PAYLOAD_OPERATIONS = ["scatter", "alltoall"]
+# Operations returning one object for each process
+LIST_RESULT_OPERATIONS = ["gather", "allgather", "alltoall"]
+
+
+def dumps(payload) -> bytes:
+    """Pickles a payload, and counts its size.
+    """
+    data = pickle.dumps(payload, protocol=pickle.HIGHEST_PROTOCOL)
+    metrics.count("mpi_bytes", len(data))
+    return data
+
+
+def loads(data):
+    """Unpickles a payload received as bytes (None if nothing was received).
+    """
+    if data is None:
+        return None
+    return pickle.loads(data)
+
+
+def collective(operation, payload, **kwargs):
+    """Calls a collective operation of the communicator (comm.bcast,
+       comm.gather, comm.allgather, comm.scatter or comm.alltoall) on the
+       payload of this process.
+    """
+    if not metrics.enabled:
+        return operation(payload, **kwargs)
+    name = operation.__name__
+    if name not in SINGLE_PAYLOAD_OPERATIONS + LIST_PAYLOAD_OPERATIONS:
+        raise ValueError("Unsupported collective operation: " + name)
+    # With bcast and scatter, only the payload of the root is sent
+    sends_payload = True
+    if name in ["bcast", "scatter"]:
+        comm = operation.__self__
+        sends_payload = comm.Get_rank() == kwargs.get("root", 0)
+    data = None
+    if sends_payload and name in SINGLE_PAYLOAD_OPERATIONS:
+        data = dumps(payload)
+    elif sends_payload:
+        data = [dumps(element) for element in payload]
+    with metrics.timer("mpi_wait_time"):
+        result = operation(data, **kwargs)
+    if name in LIST_RESULT_OPERATIONS and result is not None:
+        return [loads(element) for element in result]
+    return loads(result)
+
+
+def send(comm, payload, dest, tag) -> None:
+    """Blocking send of a payload to another process.
+    """
+    if not metrics.enabled:
+        comm.send(payload, dest=dest, tag=tag)
+        return
+    data = dumps(payload)
+    with metrics.timer("mpi_wait_time"):
+        comm.send(data, dest=dest, tag=tag)
+
+
+def isend(comm, payload, dest, tag):
+    """Non-blocking send of a payload to another process. Returns the request.
+    """
+    if not metrics.enabled:
+        return comm.isend(payload, dest=dest, tag=tag)
+    return comm.isend(dumps(payload), dest=dest, tag=tag)
+
+
+def recv(comm, source, tag, status=None):
+    """Blocking receive of a payload sent with send or isend.
+    """
+    if not metrics.enabled:
+        return comm.recv(source=source, tag=tag, status=status)
+    with metrics.timer("mpi_wait_time"):
+        data = comm.recv(source=source, tag=tag, status=status)
+    return loads(data)
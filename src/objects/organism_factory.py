@@ -8,7 +8,7 @@ import json
 import numpy as np
 from .organism_object import OrganismObject
 from .connector_object import ConnectorObject
-from .pssm_object import PssmObject
+from .pssm_object import PssmObject, BASE_INDEX
 from .aligned_organisms_representation_object import AlignedOrganismsRepresentation
 import copy
 import decimal as dec
@@ -74,7 +74,7 @@ class OrganismFactory:
         else:
             return str(self._process_rank) + "_" + str(self._organism_counter)
 
-    def get_organism(self) -> OrganismObject:
+    def get_organism(self, number_of_recognizers=None, pwm_length=None) -> OrganismObject:
         """It creates and returns a full organism datastructure
            An organism contains essentially two lists:
            - a recognizer list
@@ -82,6 +82,13 @@ class OrganismFactory:
            The placement of these elements in the lists defines
            implicitly the connections between the elements.
 
+        Args:
+            number_of_recognizers: if provided, the organism gets exactly this
+                                   number of recognizers (instead of a random
+                                   one)
+            pwm_length: if provided, length of the PWMs of the recognizers
+                        (instead of PWM_LENGTH)
+
         Returns:
             A new organism based on JSON config file
         """
@@ -96,18 +103,19 @@ class OrganismFactory:
         # lambda - 1 instead of lambda (in this way the average number of
         # recognizers will be lower by one unit) and then shifting up the
         # values by one unit.
-        number_of_recognizers = np.random.poisson(self.num_recognizers_lambda_param - 1)
-        number_of_recognizers += 1
-        
-        # avoid signle PSSM case, which breaks recombination operator, that 
-        # assumes at least one connector is present
-        if number_of_recognizers == 1:
+        if number_of_recognizers is None:
+            number_of_recognizers = np.random.poisson(self.num_recognizers_lambda_param - 1)
             number_of_recognizers += 1
+            
+            # avoid signle PSSM case, which breaks recombination operator, that 
+            # assumes at least one connector is present
+            if number_of_recognizers == 1:
+                number_of_recognizers += 1
         
         # for each recognizer in the organism
         for i in range(number_of_recognizers - 1):
             # instantiate new recognizer and append it to organism's recognizer list
-            new_recognizer = self.create_pssm(self.pwm_length)
+            new_recognizer = self.create_pssm(pwm_length)
             new_organism.recognizers.append(new_recognizer)
             # instantiate new connector and append it to organism's connector list
             _mu = random.randint(self.min_mu, self.max_mu)
@@ -115,7 +123,7 @@ class OrganismFactory:
             new_connector = ConnectorObject(_mu, _sigma, self.conf_con)
             new_organism.connectors.append(new_connector)
         # insert last recognizer in the chain and add it to list
-        new_recognizer = self.create_pssm(self.pwm_length)
+        new_recognizer = self.create_pssm(pwm_length)
         new_organism.recognizers.append(new_recognizer)
         # Set attribute that will map organism nodes to alignment matrix rows
         new_organism.set_row_to_pssm()
@@ -156,11 +164,12 @@ class OrganismFactory:
 
         return PssmObject(np.array(pwm), self.conf_pssm)
 
-    def get_pwm_column(self) -> dict:
+    def get_pwm_column(self) -> np.ndarray:
         """Generates a single column for a PWM
 
         Returns:
-            a random probability for each base [a, c, g, t]
+            a random probability for each base [a, c, g, t], as an array
+            following the BASES order of the PSSM object
         """
         
         number_of_BS_to_assign = self.pwm_number_of_binding_sites
@@ -187,14 +196,9 @@ class OrganismFactory:
 
         # Convert counts to probabilities
         np_probabilities = np.array(counts) / self.pwm_number_of_binding_sites
-        probabilities = np_probabilities.tolist()
-        
-        return {
-            "a": probabilities[0],
-            "g": probabilities[1],
-            "c": probabilities[2],
-            "t": probabilities[3],
-        }
+        
+        # The shuffled counts are assigned to the bases in the order a, g, c, t
+        return np_probabilities[[0, 2, 1, 3]]
     
     def import_organisms(self, file_name: str) -> list:
         """Import Organisms from file
@@ -252,7 +256,7 @@ class OrganismFactory:
                 rec = org.recognizers[i]
                 for p in range(rec.length):
                     for b in ['a','c','g','t']:
-                        freq = rec.pwm[p][b]
+                        freq = float(rec.pwm[p, BASE_INDEX[b]])
                         if dec.Decimal(str(freq)) % smallest_freq != 0:
                             raise Exception(
                                 ("Imported organism has PWM frequencies that are not "
@@ -298,7 +302,7 @@ class OrganismFactory:
             PSSM Object from given  pssm dictionary
 
         """
-        return PssmObject(np.array(pssm["pwm"]), self.conf_pssm)
+        return PssmObject(pssm["pwm"], self.conf_pssm)
 
     def export_organisms(self, a_organisms: list, filename: str) -> None:
         """Export a list of organisms to JSON format
@@ -348,9 +352,35 @@ class OrganismFactory:
         """
         pssm = {}
         pssm["objectType"] = "pssm"
-        pssm["pwm"] = o_pssm.pwm.tolist()
+        pssm["pwm"] = o_pssm.get_pwm_dicts()
         return pssm
     
+    def get_compact_genome(self, organism) -> tuple:
+        """Returns the minimal representation of an organism that is needed to
+           rebuild it: its ID, the PWMs of its recognizers and the mu and sigma
+           of its connectors. Used to send organisms to other MPI processes,
+           instead of pickling the whole objects (with their configuration,
+           precomputed connector values and placement checkpoints).
+        """
+        # The PWMs are sent as (length x 4) float arrays
+        pwms = [recog.pwm for recog in organism.recognizers]
+        connectors = [(conn._mu, conn._sigma) for conn in organism.connectors]
+        return (organism._id, pwms, connectors)
+    
+    def get_organism_from_compact_genome(self, genome) -> OrganismObject:
+        """Rebuilds an organism from its compact genome (see
+           get_compact_genome). The organism keeps its original ID.
+        """
+        _id, pwms, connectors = genome
+        new_organism = OrganismObject(
+            _id, self.conf_org, self.conf_pssm["MAX_COLUMNS"]
+        )
+        new_organism.set_recognizers(
+            [PssmObject(pwm, self.conf_pssm) for pwm in pwms])
+        new_organism.set_connectors(
+            [ConnectorObject(mu, sigma, self.conf_con) for mu, sigma in connectors])
+        return new_organism
+    
     
     def get_children(self, par1, par2, reference_dna_seq, pos_dna_sample):
         '''
@@ -932,8 +962,12 @@ class OrganismFactory:
         nodes) to the provided parents.
         '''
         
-        child1 = copy.deepcopy(par1)
-        child2 = copy.deepcopy(par2)
+        child1 = par1.clone()
+        child2 = par2.clone()
+        # The children are going to be mutated: most of their placement rows
+        # can be resumed from the ones of the parents
+        child1.inherit_placement_checkpoints(par1)
+        child2.inherit_placement_checkpoints(par2)
         # Assign IDs to organisms and increase factory counter
         child1.set_id(self.get_id())
         child2.set_id(self.get_id())
@@ -6,10 +6,12 @@ It allocates the full data structure
 
 
 import random
+import hashlib
 import numpy as np
-from scipy.stats import ks_2samp
-import copy
 from .placement_object import PlacementObject
+from .sequence_block_object import SequenceBlockObject
+from . import placement_engine
+from . import fitness_functions
 
 
 class OrganismObject:
@@ -81,11 +83,55 @@ class OrganismObject:
         # maximum length of PSSMs allowed
         self.max_pssm_length = max_pssm_length
         
+        # implementation of the placement algorithm:
+        # - reference (cell by cell, as described in get_reference_placement)
+        # - vectorized (row by row, see placement_engine module)
+        # - tracks (one row per recognizer, from the window scores of the
+        #   PSSMs, see placement_engine module)
+        self.placement_engine = conf["PLACEMENT_ENGINE"]
+        
+        # evaluation of the gaps in the vectorized engine:
+        # - full (all the gap sizes, quadratic in the sequence length)
+        # - banded (gap sizes within GAP_BAND_SIGMAS standard deviations from
+        #   the connector mean, plus an exact check of the others; linear in
+        #   the sequence length, same results as full)
+        # - approximate (as banded, but the gaps outside the band are only
+        #   checked where they could improve the score by more than
+        #   GAP_APPROX_TOLERANCE: each gap pass can underestimate the energy
+        #   by at most that amount)
+        self.gap_evaluation = conf["GAP_EVALUATION"]
+        self.gap_band_sigmas = conf["GAP_BAND_SIGMAS"]
+        self.gap_tolerance = conf["GAP_APPROX_TOLERANCE"]
+        # Worst-case error of the last energies computed in batch (see
+        # placement_engine.get_binding_energies); 0 unless the placement is
+        # approximate
+        self.energy_error_bound = 0.0
+        
+        # Checkpoints of the placement rows, by group of sequences (see
+        # placement_engine.get_binding_energies). They are transient: they are
+        # not copied with the organism, nor sent to other processes. Clones
+        # made for mutation can read the ones of their parent
+        self.max_placement_checkpoints = conf["PLACEMENT_CHECKPOINTS"]
+        self.placement_checkpoints = {}
+        self.parent_placement_checkpoints = None
+        
+        # Cache of the placements on single sequences, by sequence (see
+        # placement_engine.get_placement). Only the last PLACEMENT_CACHE_SIZE
+        # sequences are kept. It is transient too, and it's discarded when
+        # the genome changes (e.g. after mutations)
+        self.placement_cache_size = conf["PLACEMENT_CACHE_SIZE"]
+        self.placement_cache = {}
+        self.placement_cache_signature = None
+        
         # Map used by the placement algorithm
         # The list maps each row of the matrix of the placement scores onto a
         # column of a PSSM: each row is assigned a [pssm_idx, column_idx]
         self.row_to_pssm = []
         
+        # Lengths of the recognizers (updated together with row_to_pssm). It's
+        # the recognizer-size signature used to look up the connector scores
+        self.recog_lengths = ()
+        
         # Dictionary storing information about how the organism has to be
         # assembled by the recombination process. All the values are
         # initialized as None.
@@ -97,6 +143,85 @@ class OrganismObject:
                                       'recognizers': None,
                                       'connectors': None}
     
+    def __getstate__(self):
+        """Placement checkpoints and cached placements are left out of copies
+           and pickles.
+        """
+        state = self.__dict__.copy()
+        state["placement_checkpoints"] = {}
+        state["parent_placement_checkpoints"] = None
+        state["placement_cache"] = {}
+        state["placement_cache_signature"] = None
+        return state
+    
+    def get_cached_placement(self, dna_sequence):
+        """Returns the cache entry of the placement on a sequence, or None if
+           there is none (or if the genome changed since it was stored).
+        """
+        if len(self.placement_cache) == 0:
+            return None
+        signature = placement_engine.get_genome_signature(self)
+        if signature != self.placement_cache_signature:
+            self.placement_cache = {}
+            return None
+        return self.placement_cache.get(dna_sequence)
+    
+    def set_cached_placement(self, dna_sequence, entry) -> None:
+        """Stores the cache entry of the placement on a sequence. Only the
+           entries of the last placement_cache_size sequences are kept.
+        """
+        signature = placement_engine.get_genome_signature(self)
+        if signature != self.placement_cache_signature:
+            self.placement_cache = {}
+            self.placement_cache_signature = signature
+        self.placement_cache.pop(dna_sequence, None)
+        self.placement_cache[dna_sequence] = entry
+        while len(self.placement_cache) > self.placement_cache_size:
+            oldest_key = next(iter(self.placement_cache))
+            del self.placement_cache[oldest_key]
+    
+    def clone(self):
+        """Returns a copy of the organism. Nodes are cloned (see the clone
+           methods of PssmObject and ConnectorObject); configuration values
+           and row_to_pssm (which is rebuilt, never modified in place) are
+           shared. As with copies, placement checkpoints are left out.
+        """
+        new_organism = OrganismObject.__new__(OrganismObject)
+        new_organism.__dict__.update(self.__getstate__())
+        new_organism.recognizers = [recog.clone() for recog in self.recognizers]
+        new_organism.connectors = [conn.clone() for conn in self.connectors]
+        new_organism.assembly_instructions = {
+            key: (list(value) if isinstance(value, list) else value)
+            for key, value in self.assembly_instructions.items()}
+        return new_organism
+    
+    def get_placement_checkpoint(self, group_key):
+        """Returns the placement checkpoint of the organism for a group of
+           sequences (by content key, see SequenceBlockObject.group_keys), or
+           the one of its parent, or None if there is none.
+        """
+        if group_key in self.placement_checkpoints:
+            return self.placement_checkpoints[group_key]
+        if self.parent_placement_checkpoints is not None:
+            return self.parent_placement_checkpoints.get(group_key)
+        return None
+    
+    def set_placement_checkpoint(self, group_key, checkpoint) -> None:
+        """Stores the placement checkpoint for a group of sequences. Only the
+           checkpoints of the last max_placement_checkpoints groups are kept.
+        """
+        self.placement_checkpoints.pop(group_key, None)
+        self.placement_checkpoints[group_key] = checkpoint
+        while len(self.placement_checkpoints) > self.max_placement_checkpoints:
+            oldest_key = next(iter(self.placement_checkpoints))
+            del self.placement_checkpoints[oldest_key]
+    
+    def inherit_placement_checkpoints(self, parent) -> None:
+        """Lets the organism (a clone of parent) resume placements from the
+           checkpoints of the parent. They are only read, never modified.
+        """
+        self.parent_placement_checkpoints = parent.placement_checkpoints
+    
     def set_assembly_instructions(self, aligned_repres, connectors_table, p1_id, p2_id):
         '''
         Sets the self.assembly_instructions attribute.
@@ -269,6 +394,7 @@ class OrganismObject:
         row_to_pssm_list.append([None, 0])
         
         self.row_to_pssm = row_to_pssm_list
+        self.recog_lengths = tuple(pssm.length for pssm in pssm_list)
 
     def get_id(self) -> int:
         """Getter _id
@@ -689,7 +815,60 @@ class OrganismObject:
             
     
     
-    def get_placement(self, dna_sequence, traceback=False) -> dict:
+    def get_placement(self, dna_sequence, traceback=False) -> PlacementObject:
+        """Places the organism on a sequence, using the placement engine
+           selected in the configuration file (PLACEMENT_ENGINE).
+           All the engines return the same placement (see
+           get_reference_placement for a description of the algorithm; the
+           tracks engine can differ by floating point rounding). Recognizers
+           scanning the reverse complement strand (SCAN_REVERSE_COMPLEMENT)
+           are placed by get_reference_strand_placement in the reference
+           engine.
+        """
+        if self.placement_engine in ["vectorized", "tracks"]:
+            return placement_engine.get_placement(self, dna_sequence, traceback)
+        elif self.placement_engine == "reference":
+            return self.get_reference_placement(dna_sequence, traceback)
+        else:
+            raise ValueError('PLACEMENT_ENGINE should be "reference", '
+                             '"vectorized" or "tracks".')
+    
+    def get_energy(self, best):
+        """Returns the total binding energy given the best score of the
+           placement, applying the lower bound to the energy if required.
+           Returns None if no energy threshold method is set.
+        """
+        if self.energy_threshold_method == "organism":
+            E_threshold_value = self.energy_threshold_value
+            if best < E_threshold_value:
+                return E_threshold_value
+            else:
+                return best
+        return None
+    
+    def get_energy_bounds(self, lengths) -> tuple:
+        """Returns (lower, upper) bounds to the binding energy of the organism
+           on sequences of the given lengths. The lower bound is -inf unless
+           the energy threshold is applied.
+        """
+        upper = max(placement_engine.get_score_upper_bound(self, int(n))
+                    for n in set(lengths))
+        lower = -1 * np.inf
+        if self.energy_threshold_method == "organism":
+            lower = self.energy_threshold_value
+            upper = max(upper, lower)
+        return lower, upper
+    
+    def set_placement_energy(self, placement, best) -> None:
+        """Sets the total binding energy in the placement object, applying the
+           lower bound to the energy if required.
+        """
+        energy = self.get_energy(best)
+        if energy is not None:
+            placement.set_energy(energy)
+    
+    def get_reference_placement(self, dna_sequence, traceback=False,
+                                forward_only=False) -> PlacementObject:
         """Places the organism elements (recognizers and connectors) on a sequence
 		   in an optimal way, maximizing the energy (i.e. cumulative scores) obtained.
 		   
@@ -720,8 +899,23 @@ class OrganismObject:
 		   - Traceback through a gap enforces that a diagonal move must be taken next
 		     (this avoids double gaps in a row)
 		   - Traceback is initiated at the cell with the best value on the bottom row
+		   
+		   If some recognizer scans the reverse complement strand, the placement
+		   is computed by get_reference_strand_placement (unless forward_only
+		   is set: then only the forward strand is scored).
 		"""
+        
+        if not forward_only and any(recog.scan_reverse_complement
+                                    for recog in self.recognizers):
+            return self.get_reference_strand_placement(dna_sequence, traceback)
     
+        # Fitness evaluation only needs the energy: no traceback matrix
+        if not traceback:
+            placement = PlacementObject(self._id, dna_sequence)
+            self.set_placement_energy(placement,
+                                      self.get_reference_best_score(dna_sequence))
+            return placement
+        
         # Initialize the two matrices (alignment + traceback matrices)
         
         # Number of rows
@@ -819,13 +1013,7 @@ class OrganismObject:
         
         # Set the total binding energy in the placement object
         # Applying lower bound to energy if required
-        if self.energy_threshold_method == "organism":
-            E_threshold_value = self.energy_threshold_value
-            if best < E_threshold_value:
-                placement.set_energy(E_threshold_value)
-            else:
-                placement.set_energy(best)
-        
+        self.set_placement_energy(placement, best)
         
         if traceback:
             # Position of best (where backtracking starts from)
@@ -887,51 +1075,247 @@ class OrganismObject:
         
         return placement
     
-    def get_additive_fitness(self, a_dna: list) -> dict:
+    def get_reference_strand_placement(self, dna_sequence,
+                                       traceback=False) -> PlacementObject:
+        """Reference placement for organisms whose recognizers can bind to
+		   either strand (SCAN_REVERSE_COMPLEMENT). The algorithm is the one
+		   of get_reference_placement, computed cell by cell, one recognizer
+		   at a time:
+		   - inside a PSSM only diagonal moves are allowed, so each strand is
+		     scored on its own (the reverse complement with the reverse
+		     complement PSSM)
+		   - at the last column of the PSSM each cell keeps the best of the
+		     two strands (the forward one on ties)
+		   - the gaps are then evaluated on that row, as in the other rows at
+		     the interface with the next PSSM
+		   The traceback follows, for each recognizer, the strand and the gap
+		   kept in each cell. If the organism can't be placed on the sequence,
+		   the traceback is the one of the forward strand.
+		"""
+        n = len(dna_sequence)
+        codes = [placement_engine.BASE_INDEX[base] for base in dna_sequence]
+        n_recognizers = self.count_recognizers()
+        
+        # First row is set to zeros. The first PSSM can't be preceded by a
+        # 0-bp gap
+        row = [0.0] * (n + 1)
+        from_diagonal = [False] * (n + 1)
+        # For each recognizer: row of its last column (before the gaps) and
+        # strand of each of its cells. For each connector: row after the
+        # gaps and origin of the gap landing on each cell (None if the cell
+        # was reached diagonally)
+        exit_rows, exit_strands, gap_rows, gap_origins = [], [], [], []
+        
+        for k in range(n_recognizers):
+            recognizer = self.recognizers[k]
+            strand_pssms = [recognizer.get_pssm()]
+            if recognizer.scan_reverse_complement:
+                strand_pssms.append(recognizer.get_rc_pssm())
+            zero_gap_score = None
+            if k > 0:
+                zero_gap_score = self.connectors[k - 1].get_score_table(
+                    n, self.recog_lengths)[0]
+            
+            # Diagonal moves inside the PSSM, for each strand
+            strand_rows = []
+            for pssm in strand_pssms:
+                strand_row = row
+                for c in range(recognizer.length):
+                    new_row = [-1 * np.inf] * (n + 1)
+                    for j in range(1, n + 1):
+                        diag_score = pssm[c][codes[j - 1]]
+                        if c == 0 and zero_gap_score is not None and from_diagonal[j - 1]:
+                            diag_score = zero_gap_score + diag_score
+                        new_row[j] = strand_row[j - 1] + diag_score
+                    strand_row = new_row
+                strand_rows.append(strand_row)
+            
+            # Best strand for each cell (the forward one on ties)
+            row = list(strand_rows[0])
+            strands = [0] * (n + 1)
+            for s in range(1, len(strand_rows)):
+                for j in range(n + 1):
+                    if strand_rows[s][j] > row[j]:
+                        row[j] = strand_rows[s][j]
+                        strands[j] = s
+            exit_rows.append(row)
+            exit_strands.append(strands)
+            
+            # Horizontal moves (only at the interface with the next PSSM),
+            # evaluated on the diagonal scores only
+            if k < n_recognizers - 1:
+                gap_scores = self.connectors[k].get_score_table(
+                    n, self.recog_lengths)
+                tmp_gap_scores = list(row)
+                origins = [None] * (n + 1)
+                for j in range(1, n + 1):
+                    for start in range(j):
+                        candidate_score = row[start] + gap_scores[j - start]
+                        if candidate_score >= tmp_gap_scores[j]:
+                            tmp_gap_scores[j] = candidate_score
+                            origins[j] = start
+                row = tmp_gap_scores
+                gap_rows.append(row)
+                gap_origins.append(origins)
+                from_diagonal = [False] + [origin is None
+                                           for origin in origins[1:]]
+        
+        best = max(row)
+        if traceback and best == -1 * np.inf:
+            return self.get_reference_placement(dna_sequence, traceback,
+                                                forward_only=True)
+        placement = PlacementObject(self._id, dna_sequence)
+        self.set_placement_energy(placement, best)
+        if not traceback:
+            return placement
+        
+        # Traceback from the first best cell of the bottom row
+        ends = [0] * n_recognizers
+        starts = [0] * n_recognizers
+        strands = [0] * n_recognizers
+        is_gap = [False] * (n_recognizers - 1)
+        col = row.index(best)
+        for k in range(n_recognizers - 1, -1, -1):
+            ends[k] = col
+            starts[k] = col - self.recognizers[k].length
+            strands[k] = exit_strands[k][col]
+            if k > 0:
+                origin = gap_origins[k - 1][starts[k]]
+                is_gap[k - 1] = origin is not None
+                col = origin if origin is not None else starts[k]
+        
+        # Node scores are the differences between cumulative scores
+        recognizers_scores = []
+        connectors_scores = []
+        connectors_starts = []
+        connectors_stops = []
+        previous_score = 0
+        for k in range(n_recognizers):
+            if k > 0:
+                cumulative_score = gap_rows[k - 1][starts[k]]
+                if is_gap[k - 1]:
+                    connectors_starts.append(ends[k - 1])
+                    connectors_stops.append(starts[k])
+                else:
+                    # The 0-bp connector score is added to the first column
+                    # of the recognizer
+                    cumulative_score += self.connectors[k - 1].get_score_table(
+                        n, self.recog_lengths)[0]
+                    connectors_starts.append(starts[k])
+                    connectors_stops.append(starts[k] + 1)
+                connectors_scores.append(cumulative_score - previous_score)
+                previous_score = cumulative_score
+            cumulative_score = exit_rows[k][ends[k]]
+            recognizers_scores.append(cumulative_score - previous_score)
+            previous_score = cumulative_score
+        
+        placement.set_recognizers(starts, ends, recognizers_scores, strands)
+        placement.set_connectors(connectors_starts, connectors_stops,
+                                 connectors_scores)
+        return placement
+    
+    def get_reference_best_score(self, dna_sequence):
+        """Score-only version of get_reference_placement: returns the best
+		   score on the bottom row of the placement matrix, without building
+		   the matrices. Only two rows of scores are kept, together with the
+		   flags telling which cells of the previous row were reached with a
+		   diagonal move (all is_a_0_bp_gap needs to know).
+		   Memory is O(N) instead of O(M*N), and the scores are the same.
+		"""
+        # Number of rows
+        m = self.sum_pssm_lengths()
+        # Number of columns
+        n = len(dna_sequence)
+        
+        # First row is set to zeros
+        previous_row = [0.0] * (n + 1)
+        # The first PSSM can't be preceded by a 0-bp gap
+        from_diagonal = [False] * (n + 1)
+        
+        for i in range(1, m + 1):
+            pssm_idx, pssm_col = self.row_to_pssm[i]
+            pssm_column = self.recognizers[pssm_idx].get_pssm()[pssm_col]
+            
+            # Score of the 0-bp gap, if the row is the first one of a PSSM
+            # (other than the first PSSM)
+            zero_gap_score = None
+            if self.is_first(i) and pssm_idx > 0:
+                zero_gap_score = self.connectors[pssm_idx - 1].get_score_table(
+                    n, self.recog_lengths)[0]
+            
+            # Diagonal scores over row i (first column is -inf)
+            row = [-1 * np.inf] * (n + 1)
+            for j in range(1, n + 1):
+                diag_score = 0
+                if zero_gap_score is not None and from_diagonal[j - 1]:
+                    diag_score += zero_gap_score
+                diag_score += pssm_column[
+                    placement_engine.BASE_INDEX[dna_sequence[j - 1]]]
+                row[j] = previous_row[j - 1] + diag_score
+            
+            # All the cells of the row were reached diagonally
+            from_diagonal = [False] + [True] * n
+            
+            # Horizontal scores over row i
+            # (only in rows at the interface with the next PSSM)
+            if self.is_last(i) and i != m:
+                gap_scores = self.connectors[pssm_idx].get_score_table(
+                    n, self.recog_lengths)
+                # Gaps are evaluated on the diagonal scores only
+                tmp_gap_scores = row.copy()
+                for j in range(1, n + 1):
+                    for start in range(j):
+                        candidate_score = row[start] + gap_scores[j - start]
+                        if candidate_score >= tmp_gap_scores[j]:
+                            tmp_gap_scores[j] = candidate_score
+                            from_diagonal[j] = False
+                row = tmp_gap_scores
+            
+            previous_row = row
+        
+        # Best value on bottom row
+        return max(previous_row)
+    
+    def get_additive_fitness(self, a_dna: list, energies=None) -> dict:
         """
 
         Args:
-            a_dna: list of dna sequences
+            a_dna: list of dna sequences, or SequenceBlockObject
+            energies: binding energies on a_dna, if already computed
 
         Returns:
             average/sum of the energy of the organism on the sequences
         """
 
-        scores = []
-		# for each sequence in the provided sequence set
-        for s_dna in a_dna:
-            placement = self.get_placement(s_dna)
-            energy = placement.energy  # energy          
-            scores.append(energy)
+        if energies is None:
+            energies = self.get_binding_energies(a_dna)
         
-        score_stdev = np.std(scores)
-        if self.cumulative_fit_method == "sum":
-            # Compute fitness score as sum over the positive scores
-            score = np.sum(scores)
-        
-        elif self.cumulative_fit_method == "mean":
-            # Compute fitness score as average positive score
-            score = np.mean(scores)
-            
-        elif self.cumulative_fit_method == "median":
-            # Compute fitness score as median positive score
-            score = np.median(scores)
+        # Sum, mean or median of the energies (CUMULATIVE_FIT_METHOD)
+        score, score_stdev = fitness_functions.get_additive_score(
+            energies, self.cumulative_fit_method)
         
         return {"score": score, "stdev" : score_stdev}
     
-    def get_binding_energies(self, a_dna: list, traceback=False) -> list:
+    def get_binding_energies(self, a_dna, traceback=False) -> list:
         """Return the binding energies for an array of DNA sequences.
+           With the vectorized and tracks engines, the sequences are placed in
+           batch (see placement_engine.get_binding_energies).
 
         Args:
-            a_dna: list of dna sequences
+            a_dna: list of dna sequences, or SequenceBlockObject
 
         Returns:
             list of binding eneregies
         """
-
+        if not isinstance(a_dna, SequenceBlockObject):
+            a_dna = SequenceBlockObject(a_dna)
+        
+        if self.placement_engine in ["vectorized", "tracks"]:
+            return placement_engine.get_binding_energies(self, a_dna)
+        
         binding_energies = []
 		# for each sequence in the provided sequence set
-        for s_dna in a_dna:
+        for s_dna in a_dna.sequences:
             placement = self.get_placement(s_dna)
             energy = placement.energy
             binding_energies.append(energy)
@@ -939,7 +1323,8 @@ class OrganismObject:
         return binding_energies
 
     def get_kolmogorov_fitness(self, pos_dataset: list, neg_dataset: list,
-                               traceback=False) -> float:
+                               traceback=False, pos_energies=None,
+                               neg_energies=None) -> float:
         """Returns the organism's fitness, defined as the Kolmogorov-Smirnov
            test statistic. This is bounded in [0,1].
            Test null assumes the samples are drawn from the same (continuous)
@@ -947,30 +1332,33 @@ class OrganismObject:
            The statistic is sensitive to differences in both location and shape 
            of the empirical cumulative distribution functions of the two samples.
         Args:
-            pos_dataset: list of dna sequences in the positive dataset
-            neg_dataset: list of dna sequences in the negative dataset
+            pos_dataset: list of dna sequences in the positive dataset, or
+                         SequenceBlockObject
+            neg_dataset: list of dna sequences in the negative dataset, or
+                         SequenceBlockObject
+            pos_energies, neg_energies: binding energies on the datasets, if
+                                        already computed
         Returns:
             fitness assigned to the organism
         """       
         # Values on the positive set
-        pos_values = []
-        for s_dna in pos_dataset:
-            placement = self.get_placement(s_dna)
-            pos_values.append(placement.energy)  # append sequence energy score
+        pos_values = pos_energies
+        if pos_values is None:
+            pos_values = self.get_binding_energies(pos_dataset)
         
         # Values on the negative set
-        neg_values = []
-        for s_dna in neg_dataset:
-            placement = self.get_placement(s_dna)
-            neg_values.append(placement.energy)  # get sequence energy score
+        neg_values = neg_energies
+        if neg_values is None:
+            neg_values = self.get_binding_energies(neg_dataset)
         
-        # Compute fitness score as a Boltzmannian probability
-        kolmogorov_fitness = ks_2samp(pos_values, neg_values).statistic
+        kolmogorov_fitness = fitness_functions.get_kolmogorov_score(pos_values,
+                                                                   neg_values)
         
         return {"score": kolmogorov_fitness}
     
     def get_boltz_fitness(self, pos_dataset: list, neg_dataset: list,
-                          genome_length: int) -> float:
+                          genome_length: int, pos_energies=None,
+                          neg_energies=None) -> float:
         """Returns the organism's fitness, defined as the probability that the regulator binds a
         positive sequence. All the binding energies are turned into probabilities according to a
         Boltzmannian distribution. The probability of binding a particular sequence, given the binding
@@ -980,41 +1368,37 @@ class OrganismObject:
         regulator that needs to find its targets on an entire genome).
         A coefficient called neg_factor is computed, so that the value of Z can be as high as if there
         were as	many negative sequences as required to cover the entire genome.
+        The probability is computed in log space (see
+        fitness_functions.get_boltzmann_score), so it doesn't overflow.
 
         Args:
-            pos_dataset: list of dna sequences in the positive dataset
-            neg_dataset: list of dna sequences in the negative dataset
+            pos_dataset: list of dna sequences in the positive dataset, or
+                         SequenceBlockObject
+            neg_dataset: list of dna sequences in the negative dataset, or
+                         SequenceBlockObject
             genome_length: integer representing the length of the genome
+            pos_energies, neg_energies: binding energies on the datasets, if
+                                        already computed
 
         Returns:
             fitness assigned to the organism
         """
         
-        # Values on the positive set
-        pos_values = []
-        for s_dna in pos_dataset:
-            placement = self.get_placement(s_dna)
-            boltz_exp = np.e**placement.energy  # exp(energy)
-            pos_values.append(boltz_exp)
+        if not isinstance(neg_dataset, SequenceBlockObject):
+            neg_dataset = SequenceBlockObject(neg_dataset)
         
-        # Values on the negative set
-        neg_values = []
-        neg_lengths = []
-        for s_dna in neg_dataset:
-            placement = self.get_placement(s_dna)
-            boltz_exp = np.e**placement.energy  # exp(energy)
-            neg_values.append(boltz_exp)
-            neg_lengths.append(len(s_dna))
+        if pos_energies is None:
+            pos_energies = self.get_binding_energies(pos_dataset)
+        if neg_energies is None:
+            neg_energies = self.get_binding_energies(neg_dataset)
         
         # Scaling factor, used to over-represent the negative scores, so that
         # it simulates a genome of specified length
-        neg_factor = genome_length//sum(neg_lengths)
-        
-        # Partition function
-        Z = sum(pos_values) + neg_factor * sum(neg_values)
+        neg_factor = genome_length / neg_dataset.get_total_length()
         
         # Compute fitness score as a Boltzmannian probability
-        boltz_fitness = sum(pos_values) / Z
+        boltz_fitness = fitness_functions.get_boltzmann_score(
+            pos_energies, neg_energies, neg_factor)
         
         return {"score": boltz_fitness}
 
@@ -1060,10 +1444,9 @@ class OrganismObject:
 		   obtain the energy of the connector.
 		"""
         if d < s_dna_len:
-            # !!! New input param for connector.get_score: the list of the lengths of the recognizers
-            recog_lengths = [recog.length for recog in self.recognizers]
-            gap_score = self.connectors[connector_idx].get_score(d, s_dna_len, recog_lengths)
-            return gap_score
+            score_table = self.connectors[connector_idx].get_score_table(
+                s_dna_len, self.recog_lengths)
+            return score_table[d]
         else:
             return -1 * np.inf
     
@@ -1073,7 +1456,8 @@ class OrganismObject:
         pssm_index = self.row_to_pssm[row_idx_from_placement_matrix][0]
         pssm_column = self.row_to_pssm[row_idx_from_placement_matrix][1]
         pssm_object = self.recognizers[pssm_index]
-        score = pssm_object.pssm[pssm_column][nucleotide]
+        score = pssm_object.get_pssm()[pssm_column,
+                                       placement_engine.BASE_INDEX[nucleotide]]
         return score
     
     def get_diag_score(self, pointers_mat, row_idx, col_idx, dna_sequence):
@@ -1093,11 +1477,9 @@ class OrganismObject:
 			# diagonal score [connector needs to the length of the DNA seq]
             pssm_idx = self.row_to_pssm[row_idx][0]
             connector = self.connectors[pssm_idx - 1]
-            
-            # !!! New input param for connector.get_score: the list of the lengths of the recognizers
-            recog_lengths = [recog.length for recog in self.recognizers]
-            
-            zero_gap_score = connector.get_score(0, len(dna_sequence), recog_lengths)
+            score_table = connector.get_score_table(len(dna_sequence),
+                                                    self.recog_lengths)
+            zero_gap_score = score_table[0]
             diag_score += zero_gap_score
         
 		# get nucleotide and compute PSSM score for it
@@ -1269,6 +1651,17 @@ class OrganismObject:
         return [node_scores, node_placements_right_ends, columns_of_0_bp_gaps]
     
     
+    def get_genome_hash(self) -> str:
+        """Returns a canonical hash of the genome of the organism: the scores
+           of its PSSMs and the parameters of its connectors, in order.
+           Organisms with the same hash have the same fitness. The hash doesn't
+           depend on the process computing it, so it can be compared across
+           MPI processes.
+        """
+        signature = (tuple(recog.get_signature() for recog in self.recognizers),
+                     tuple(conn.get_signature() for conn in self.connectors))
+        return hashlib.sha1(repr(signature).encode()).hexdigest()
+    
     def get_random_connector(self) -> int:
         """Returns the index of a random connector of the organism
 
@@ -1311,14 +1704,14 @@ class OrganismObject:
         """ Adds a copy of the given connector to the organism, by appending
         it to the  organism.connectors  list.
         """
-        connector = copy.deepcopy(connector_obj)
+        connector = connector_obj.clone()
         self.connectors.append(connector)
 
     def append_recognizer(self, recognizer_obj):
         """ Adds a copy of the given recognizer to the organism, by appending
         it to the  organism.recognizers  list.
         """
-        recognizer = copy.deepcopy(recognizer_obj)
+        recognizer = recognizer_obj.clone()
         self.recognizers.append(recognizer)
         # Set/update the row_to_pssm attribute, used for the placement
         self.set_row_to_pssm()
@@ -1340,6 +1733,12 @@ class OrganismObject:
             filename: Name of the file to export the organism
         """
         organism_file = open(filename, "a+")
+        self.write_export(organism_file)
+        organism_file.close()
+    
+    def write_export(self, organism_file) -> None:
+        """Writes the whole tree data structure to an open file (see export)
+        """
         organism_file.write("***** Organism {} *****".format(self._id))
         
         for i in range(len(self.recognizers) - 1):
@@ -1348,7 +1747,6 @@ class OrganismObject:
         self.recognizers[-1].export(organism_file)
 
         organism_file.write("\n\n")
-        organism_file.close()
 
     def export_results(self, a_dna: list, filename: str) -> None:
         """Exports the binding profile of the organism against each of the 
@@ -1361,11 +1759,17 @@ class OrganismObject:
         """
         
         ofile = open(filename, "a+")
+        self.write_results(a_dna, ofile)
+        ofile.close()
+    
+    def write_results(self, a_dna: list, ofile) -> None:
+        """Writes the binding profile of the organism against each of the
+           DNA sequences to an open file (see export_results)
+        """
         # for each DNA sequence
         for s_dna in a_dna:
             placement = self.get_placement(s_dna.lower(), traceback=True)
             placement.print_placement(outfile = ofile)
-        ofile.close()
 
     def print_result(self, s_dna: str) -> None:
         """Prints the binding profile of the organism against the 
@@ -0,0 +1,709 @@
+# -*- coding: utf-8 -*-
+"""
+Placement engine
+Row-at-a-time implementation of the placement algorithm.
+
+The reference implementation (OrganismObject.get_reference_placement) fills
+the placement matrix one cell at a time, looking up every nucleotide in the
+PSSMs. This module implements the same algorithm on numpy arrays:
+    - the DNA sequence is encoded once as an array of base indexes
+    - the (length x 4) score array of each PSSM is used as it is
+    - a whole row of the placement matrix is computed at once
+
+Inside a PSSM only diagonal moves are allowed, so the engine does not need to
+keep the whole (M+1)x(N+1) matrix. For each recognizer it keeps just the row
+at the last column of the PSSM (before and after the gap pass) and, for each
+cell of that row, where the optimal horizontal move started. That is all the
+information the traceback needs.
+
+The scores computed here are exactly the same as the ones computed by the
+reference implementation (the same floating point operations are applied in
+the same order), and so are the traceback decisions.
+
+Strand mode: recognizers with SCAN_REVERSE_COMPLEMENT activated bind to the
+strand that gives them the best score. For those recognizers the forward and
+the reverse complement PSSMs are stacked, and the diagonal moves of both
+strands are computed in the same pass (one lookup of the encoded sequence per
+PSSM column). At the last column of the PSSM each cell keeps the best of the
+two strands (the forward one on ties), as in the strand-aware reference
+implementation (OrganismObject.get_reference_strand_placement).
+
+Tracks engine (PLACEMENT_ENGINE "tracks"): inside a PSSM the moves are all
+diagonal, so the row at the last column of a PSSM is the row entering it,
+shifted by the length of the PSSM, plus the score of the window ending at
+each column. The score of every window is computed first, for the whole
+sequence (PssmObject.get_score_track), and the rows are then computed one
+per recognizer instead of one per PSSM column. The tracks don't depend on the
+rest of the organism: with a track store (see set_track_store), they're
+computed once per PSSM content and batch of sequences, and shared by all the
+organisms of the process carrying the same PSSM. The scores are the same as the
+ones of the vectorized engine, up to floating point rounding (the PSSM
+columns are added up in a different order).
+
+Buffers: the rows computed inside a PSSM and the arrays of the banded gap
+pass are temporary, and they're written into the buffers of an arena (see
+BufferArenaObject) instead of being allocated at each placement. Only the
+rows entering and leaving each recognizer, which can be stored by the
+placement cache and the checkpoints, are new arrays.
+"""
+
+import numpy as np
+from .placement_object import PlacementObject
+# Fixed base-index order used to encode sequences, shared with the PSSM arrays
+from .pssm_object import BASES, BASE_INDEX
+from .metrics_object import metrics
+from .buffer_arena_object import BufferArenaObject
+
+# Lookup table from ASCII codes to base indexes (255 marks invalid characters)
+ASCII_TO_INDEX = np.full(256, 255, dtype=np.uint8)
+for _base, _idx in BASE_INDEX.items():
+    ASCII_TO_INDEX[ord(_base)] = _idx
+
+# Value used in the gap origins arrays when the cell was reached diagonally
+NO_GAP = -1
+
+# Store of the score tracks of the tracks engine (a TrackStoreObject), shared
+# by all the organisms of the process. None if tracks are not stored
+track_store = None
+
+# Scratch buffers of the placements (one set per thread)
+arena = BufferArenaObject()
+
+
+def set_track_store(store) -> None:
+    """Sets the store of the score tracks used by the tracks engine (None to
+       stop storing them).
+    """
+    global track_store
+    track_store = store
+
+
+def encode_sequence(dna_sequence: str) -> np.ndarray:
+    """Encodes a DNA sequence (lowercase string) as an array of base indexes,
+       following the BASES order.
+    """
+    codes = ASCII_TO_INDEX[np.frombuffer(dna_sequence.encode("ascii"),
+                                         dtype=np.uint8)]
+    if codes.size > 0 and codes.max() == 255:
+        raise ValueError("The DNA sequence contains characters other than "
+                         "'a', 'c', 'g' and 't'.")
+    return codes
+
+
+def pack_pssm(pssm_object) -> np.ndarray:
+    """Returns the scores of a PSSM as a (length x 4) float array, with the
+       columns of the array following the BASES order. The PSSM already
+       stores its scores that way: the array is returned without copying, and
+       it must not be modified.
+    """
+    return pssm_object.get_pssm()
+
+
+def pack_strands(pssm_object) -> np.ndarray:
+    """Returns the scores of a PSSM for the strands it can bind to, as a
+       (strands x length x 4) array: only the forward strand, or the forward
+       strand followed by the reverse complement one if the PSSM scans the
+       reverse complement too.
+    """
+    if pssm_object.scan_reverse_complement:
+        return np.stack((pack_pssm(pssm_object), pssm_object.get_rc_pssm()))
+    return pack_pssm(pssm_object)[None]
+
+
+def get_gap_scores(organism, connector_idx, s_dna_len) -> np.ndarray:
+    """Returns the vector of the scores of a connector for all the possible
+       gap sizes on a sequence of length s_dna_len. Element d is the score of
+       a gap of d bp, and it's -inf for gaps that don't fit the sequence
+       (d >= s_dna_len). Element 0 is the score of a 0 bp gap, which is never
+       used as a horizontal move.
+       The vector is the table memoized by the connector: it must not be
+       modified.
+    """
+    connector = organism.connectors[connector_idx]
+    return connector.get_score_table(s_dna_len, organism.recog_lengths)
+
+
+def get_zero_gap_score(organism, connector_idx, s_dna_len):
+    """Returns the score of a connector for a gap of 0 bp (two PSSMs placed
+       back to back).
+    """
+    return get_gap_scores(organism, connector_idx, s_dna_len)[0]
+
+
+def get_best_gaps(row, gap_scores, landing_cols):
+    """Evaluates all the gaps landing on the given columns of a row, and
+       returns the best one for each column. As in the reference
+       implementation, when several gaps give the same score the shortest one
+       is kept, and when all the gaps are -inf the one starting from the
+       previous column is kept.
+
+    Args:
+        row: scores of the row (diagonal moves only), of shape (..., n+1)
+        gap_scores: connector scores by gap size, of shape (n+1,)
+        landing_cols: array of the columns to be evaluated
+
+    Returns:
+        the score of the best gap landing on each of the given columns, and
+        the column where it starts, both of shape (..., len(landing_cols))
+    """
+    n = row.shape[-1] - 1
+
+    # Gap size for each (landing column, starting column) pair
+    gap_sizes = landing_cols[:, None] - np.arange(n + 1)[None, :]
+    # Only gaps going left to right are possible
+    connector_scores = np.where(gap_sizes > 0,
+                                gap_scores[np.clip(gap_sizes, 0, n)],
+                                -1 * np.inf)
+
+    # candidates[..., j, start] is the score of the gap from start to j
+    candidates = row[..., None, :] + connector_scores
+
+    # Last starting column achieving the maximum (i.e. the shortest gap)
+    last_best = n - np.argmax(candidates[..., ::-1], axis=-1)
+    best = np.take_along_axis(candidates, last_best[..., None], axis=-1)[..., 0]
+    last_best = np.where(best == -1 * np.inf, landing_cols - 1, last_best)
+    return best, last_best
+
+
+def apply_best_gaps(row, best, last_best):
+    """Gaps replace diagonal moves if they're better or equal. Returns the
+       updated row and, for each column, the column where the gap started
+       (NO_GAP if the diagonal move was kept).
+    """
+    use_gap = best >= row
+    use_gap[..., 0] = False
+    new_row = np.where(use_gap, best, row)
+    origins = np.where(use_gap, last_best, NO_GAP)
+    return new_row, origins
+
+
+def gap_pass(row, gap_scores):
+    """Horizontal moves over the last row of a PSSM.
+       For each column j, all the gaps landing on j are evaluated, and the
+       best one replaces the diagonal score if it's better or equal.
+       Time and memory are quadratic in the length of the sequence.
+
+    Args:
+        row: scores of the row (diagonal moves only), of shape (..., n+1)
+        gap_scores: connector scores by gap size, of shape (n+1,)
+
+    Returns:
+        the updated row and the gap origins (see apply_best_gaps)
+    """
+    n = row.shape[-1] - 1
+    best, last_best = get_best_gaps(row, gap_scores, np.arange(n + 1))
+    return apply_best_gaps(row, best, last_best)
+
+
+def get_gap_band(connector, s_dna_len, n_sigmas):
+    """Returns the (min, max) gap sizes within n_sigmas standard deviations
+       from the mean of the connector, clipped to the gap sizes that fit the
+       sequence.
+    """
+    lo = max(1, int(np.floor(connector._mu - n_sigmas * connector._sigma)))
+    hi = min(s_dna_len - 1, int(np.ceil(connector._mu + n_sigmas * connector._sigma)))
+    return lo, hi
+
+
+def banded_gap_pass(row, gap_scores, band, tolerance=None, max_col=None):
+    """Horizontal moves over the last row of a PSSM, in linear time.
+
+       The connector score only depends on the gap size d, so the gaps with
+       d within the band (typically mu +/- k*sigma) are evaluated with one
+       vector operation per gap size. The gaps outside the band are not
+       evaluated: their scores are bounded from above by
+           max(row[start] for start < j - hi) + max(gap_scores[d > hi])
+       and by
+           max(row[start] for start < j) + max(gap_scores[d < lo])
+       Where this bound is strictly lower than the best gap within the band,
+       that gap is provably the best one, and where it's strictly lower than
+       the diagonal score, the diagonal move provably wins. Only the (few)
+       columns where neither holds are evaluated on all the gap sizes, so the
+       result is always the same as the one of gap_pass.
+
+       Approximate mode (tolerance is not None): the columns where the best
+       gap within the band is kept (it's better than or equal to the diagonal
+       score) and the bound exceeds it by no more than tolerance are not
+       evaluated either. The exact cell is reached by a gap too, so it can
+       only be followed by the same moves, and its score can be lower than
+       the exact one by at most bound - best <= tolerance: the approximate
+       scores are never higher than the exact ones. Cells where the diagonal
+       score lies between the best gap within the band and the bound are
+       always evaluated exactly (the exact cell could be reached by a gap,
+       and could not be followed by a 0-bp gap). Columns after max_col
+       (where the recognizers to the right can't fit anymore) are never
+       evaluated exactly.
+
+    Args:
+        row: scores of the row (diagonal moves only), of shape (..., n+1)
+        gap_scores: connector scores by gap size, of shape (n+1,)
+        band: (min, max) gap sizes to be evaluated in the vectorized sweep
+        tolerance: None for the exact evaluation, or the maximum error
+                   accepted on a cell
+        max_col: in approximate mode, last column from which a complete
+                 placement can still be reached
+
+    Returns:
+        the updated row, the gap origins (see apply_best_gaps) and the upper
+        bound to the error of the scores of the row, of shape (...,): always
+        0 in exact mode
+    """
+    n = row.shape[-1] - 1
+    lo, hi = band
+    no_error = np.zeros(row.shape[:-1])
+    if lo > hi:
+        return gap_pass(row, gap_scores) + (no_error,)
+
+    cols = np.arange(n + 1)
+
+    # Sweep over the gap sizes within the band. Gap sizes are visited from the
+    # largest to the smallest, so that the shortest gap wins ties
+    best = arena.get("gap_best", row.shape)
+    best.fill(-1 * np.inf)
+    last_best = arena.get("gap_last_best", row.shape, int)
+    last_best.fill(0)
+    candidates = arena.get("gap_candidates", row.shape)
+    better = arena.get("gap_better", row.shape, bool)
+    for d in range(hi, lo - 1, -1):
+        candidates[..., :d] = -1 * np.inf
+        np.add(row[..., :n + 1 - d], gap_scores[d], out=candidates[..., d:])
+        np.greater_equal(candidates, best, out=better)
+        better[..., :d] = False
+        np.copyto(best, candidates, where=better)
+        np.copyto(last_best, cols - d, where=better)
+
+    # Upper bound to the score of the gaps outside the band
+    prefix_max = np.maximum.accumulate(row, axis=-1,
+                                       out=arena.get("gap_prefix_max", row.shape))
+    bound = arena.get("gap_bound", row.shape)
+    bound.fill(-1 * np.inf)
+    # Gaps longer than the band
+    bound[..., hi + 1:] = prefix_max[..., :n - hi] + gap_scores[hi + 1:].max()
+    # Gaps shorter than the band
+    if lo > 1:
+        bound[..., 1:] = np.maximum(bound[..., 1:],
+                                    prefix_max[..., :-1] + gap_scores[1:lo].max())
+
+    # If all the gaps are -inf, the one starting from the previous column is kept
+    all_inf = (bound == -1 * np.inf) & (best == -1 * np.inf)
+    np.copyto(last_best, cols - 1, where=all_inf)
+
+    # Exact evaluation of the columns where neither the band nor the diagonal
+    # move is provably optimal
+    undecided = ~((bound < best) | (bound < row) | all_inf)
+    undecided[..., 0] = False
+    error = no_error
+    if tolerance is not None:
+        if max_col is not None:
+            undecided[..., max_col + 1:] = False
+        # Only cells where the gap is kept, as in the exact pass
+        accepted = undecided & (bound <= best + tolerance) & (best >= row)
+        undecided &= ~accepted
+        if max_col is not None:
+            accepted[..., max_col + 1:] = False
+        error = np.where(accepted, bound - best, 0).max(axis=-1)
+    landing_cols = np.nonzero(undecided.reshape(-1, n + 1).any(axis=0))[0]
+    metrics.count("gap_exact_columns", int(undecided.sum()))
+    if landing_cols.size > 0:
+        exact_best, exact_last_best = get_best_gaps(row, gap_scores, landing_cols)
+        to_update = undecided[..., landing_cols]
+        best[..., landing_cols] = np.where(to_update, exact_best,
+                                           best[..., landing_cols])
+        last_best[..., landing_cols] = np.where(to_update, exact_last_best,
+                                                last_best[..., landing_cols])
+
+    return apply_best_gaps(row, best, last_best) + (error,)
+
+
+def get_track_row(organism, k, codes, row, from_diagonal, track_key=None):
+    """Tracks engine: returns the row of the last column of recognizer k, and
+       the strand giving each of its cells, from the row entering the
+       recognizer (see fill_recognizer_rows).
+    """
+    n = codes.shape[-1]
+    recognizer = organism.recognizers[k]
+    length = recognizer.length
+    
+    tracks = None
+    if track_key is not None and track_store is not None:
+        store_key = (recognizer.get_hash(), track_key)
+        tracks = track_store.get(store_key)
+    if tracks is None:
+        tracks = recognizer.get_score_track(codes)
+        if track_key is not None and track_store is not None:
+            track_store.set(store_key, tracks)
+    track, track_strands = tracks
+    width = track.shape[-1]
+    
+    entry = row[..., :width]
+    # Contiguous PSSMs (0-bp gap) get the 0-bp score of the connector
+    if k > 0:
+        entry = np.where(from_diagonal[..., :width],
+                         entry + get_zero_gap_score(organism, k - 1, n),
+                         entry)
+    
+    # Cells before the end of the first window are -inf
+    new_row = np.full(row.shape, -1 * np.inf)
+    new_row[..., length:] = entry + track
+    strands = np.zeros(row.shape, dtype=int)
+    strands[..., length:] = track_strands
+    return new_row, strands
+
+
+def fill_recognizer_rows(organism, codes, energy_only=False, resume=None,
+                         checkpoints=None, track_key=None):
+    """Fills the placement matrix of the organism on an encoded sequence.
+
+    Args:
+        organism: the OrganismObject being placed
+        codes: encoded DNA sequence, of shape (..., n)
+        energy_only: if True, only the bottom row of the matrix is returned
+                     (exit_rows has one element, gap_rows and gap_origins are
+                     empty), so that memory doesn't grow with the number of
+                     recognizers
+        resume: (k, row, from_diagonal, error) state to resume the
+                computation from, as stored in checkpoints: recognizers before
+                k are skipped. Only meaningful with energy_only (rows of the
+                skipped recognizers are not returned)
+        checkpoints: if it's a list, the state of the computation entering
+                     each recognizer (from the first one computed) is appended
+                     to it, as a (k, row, from_diagonal, error) tuple
+        track_key: tracks engine only. If not None, it identifies the content
+                   of codes, and the score tracks of the PSSMs are looked up
+                   in the track store (see set_track_store) under it
+
+    Returns:
+        exit_rows: for each recognizer, the row of its last PSSM column before
+                   the gap pass
+        exit_strands: for each recognizer, the strand (0 forward, 1 reverse
+                      complement) giving each cell of its exit row. Empty if
+                      energy_only
+        gap_rows: for each connector, the row of the last PSSM column of the
+                  recognizer to its left, after the gap pass
+        gap_origins: for each connector, the starting column of the gap
+                     landing on each cell of the corresponding gap row
+                     (NO_GAP when the cell was reached diagonally)
+        error: upper bound to the difference between the exact scores and
+               the ones computed, of shape (...,). It's 0 unless the gaps
+               are evaluated in approximate mode (GAP_EVALUATION
+               "approximate"). The errors of the gap passes add up: maximum
+               and sum don't amplify them
+    """
+    n = codes.shape[-1]
+    n_recognizers = organism.count_recognizers()
+
+    if resume is None:
+        first_k = 0
+        # First row of the placement matrix
+        row = np.zeros(codes.shape[:-1] + (n + 1,))
+        # The first PSSM can't be preceded by a 0-bp gap
+        from_diagonal = np.zeros(row.shape, dtype=bool)
+        error = np.zeros(codes.shape[:-1])
+    else:
+        first_k, row, from_diagonal, error = resume
+
+    exit_rows = []
+    exit_strands = []
+    gap_rows = []
+    gap_origins = []
+
+    if metrics.enabled:
+        batch = int(np.prod(codes.shape[:-1]))
+        metrics.count("dp_cells",
+                      batch * n * sum(organism.recog_lengths[first_k:]))
+        metrics.count("gap_passes", batch * max(n_recognizers - 1 - first_k, 0))
+
+    for k in range(first_k, n_recognizers):
+        # The stored arrays are never modified in place, so they can be
+        # shared by the checkpoints of several organisms
+        if checkpoints is not None:
+            checkpoints.append((k, row, from_diagonal, error))
+        
+        if organism.placement_engine == "tracks":
+            row, strands = get_track_row(organism, k, codes, row,
+                                         from_diagonal, track_key)
+            if not energy_only:
+                exit_strands.append(strands)
+        else:
+            strand_scores = pack_strands(organism.recognizers[k])
+            # The rows inside the PSSM alternate between two arena buffers
+            shape = (strand_scores.shape[0],) + codes.shape[:-1]
+            diag_scores = arena.get("diag_scores", shape + (n,))
+            buffers = (arena.get("diag_row_0", shape + (n + 1,)),
+                       arena.get("diag_row_1", shape + (n + 1,)))
+    
+            for c in range(organism.recognizers[k].length):
+                # PSSM column scores over the whole sequence, for each strand
+                # (leading axis)
+                np.take(strand_scores[:, c], codes, axis=1, out=diag_scores)
+    
+                # Contiguous PSSMs (0-bp gap) get the 0-bp score of the connector
+                if c == 0 and k > 0:
+                    zero_gap_score = get_zero_gap_score(organism, k - 1, n)
+                    np.add(diag_scores, zero_gap_score, out=diag_scores,
+                           where=from_diagonal[..., :-1])
+    
+                # Diagonal moves (first column is -inf)
+                new_row = buffers[c % 2]
+                new_row[..., 0] = -1 * np.inf
+                np.add(row[..., :-1], diag_scores, out=new_row[..., 1:])
+                row = new_row
+    
+            # Best strand for each cell (the first one, forward, on ties). The
+            # reduction leaves the arena buffers
+            if not energy_only:
+                exit_strands.append(np.argmax(row, axis=0))
+            row = row.max(axis=0)
+
+        if not energy_only or k == n_recognizers - 1:
+            exit_rows.append(row)
+
+        # Horizontal moves (gaps) at the interface with the next PSSM
+        if k < n_recognizers - 1:
+            gap_scores = get_gap_scores(organism, k, n)
+            if organism.gap_evaluation == "banded":
+                band = get_gap_band(organism.connectors[k], n,
+                                    organism.gap_band_sigmas)
+                row, origins, _ = banded_gap_pass(row, gap_scores, band)
+            elif organism.gap_evaluation == "approximate":
+                band = get_gap_band(organism.connectors[k], n,
+                                    organism.gap_band_sigmas)
+                # The recognizers to the right need the last columns
+                max_col = max(n - sum(organism.recog_lengths[k + 1:]), -1)
+                row, origins, pass_error = banded_gap_pass(
+                    row, gap_scores, band, organism.gap_tolerance, max_col)
+                error = error + pass_error
+            else:
+                row, origins = gap_pass(row, gap_scores)
+            if not energy_only:
+                gap_rows.append(row)
+                gap_origins.append(origins)
+            # Cells reached diagonally can be followed by a 0-bp gap
+            from_diagonal = origins == NO_GAP
+            from_diagonal[..., 0] = False
+
+    return exit_rows, exit_strands, gap_rows, gap_origins, error
+
+
+def get_placement(organism, dna_sequence, traceback=False) -> PlacementObject:
+    """Places the organism on a DNA sequence. Same inputs and outputs as
+       OrganismObject.get_reference_placement.
+       
+       If the organism keeps a placement cache (PLACEMENT_CACHE_SIZE > 0), all
+       the rows of the placement matrix are kept for the sequence, even if no
+       traceback is required: a later traceback on the sequence is rebuilt
+       from the stored rows, without filling the matrix again, and the
+       placement is stored too. Placements returned from the cache are shared:
+       they must not be modified.
+    """
+    use_cache = organism.placement_cache_size > 0
+    entry = None
+    if use_cache:
+        entry = organism.get_cached_placement(dna_sequence)
+        metrics.count("placement_cache_misses" if entry is None
+                      else "placement_cache_hits")
+    
+    if entry is None:
+        metrics.count("placements")
+        codes = encode_sequence(dna_sequence)
+        rows = fill_recognizer_rows(organism, codes,
+                                    energy_only=not (traceback or use_cache))
+        entry = {"codes": codes, "rows": rows, "placement": None}
+        if use_cache:
+            organism.set_cached_placement(dna_sequence, entry)
+    elif entry["placement"] is not None:
+        return entry["placement"]
+    
+    codes = entry["codes"]
+    exit_rows, exit_strands, gap_rows, gap_origins, error = entry["rows"]
+
+    # Get best binding energy (max value on bottom row)
+    last_row = exit_rows[-1]
+    best = last_row.max()
+
+    placement = PlacementObject(organism._id, dna_sequence)
+    organism.set_placement_energy(placement, best)
+    placement.set_energy_error_bound(float(error))
+
+    if traceback:
+        # Organisms that can't be placed on the sequence and 1-column PSSMs
+        # are corner cases of the reference traceback: leave them to it
+        # (unless some recognizer scans both strands: the strand-aware
+        # reference traceback has no such corner cases)
+        lengths = [recog.length for recog in organism.recognizers]
+        both_strands = any(recog.scan_reverse_complement
+                           for recog in organism.recognizers)
+        if best == -1 * np.inf or (min(lengths) < 2 and not both_strands):
+            placement = organism.get_reference_placement(dna_sequence, traceback)
+        else:
+            trace_recognizer_rows(organism, codes, placement, exit_rows,
+                                  exit_strands, gap_rows, gap_origins)
+        entry["placement"] = placement
+
+    return placement
+
+
+def get_score_upper_bound(organism, s_dna_len) -> float:
+    """Returns an upper bound to the score of any placement of the organism on
+       a sequence of length s_dna_len: the sum of the best score of each PSSM
+       column and of the best score of each connector (0-bp gaps included).
+    """
+    bound = sum(float(pack_pssm(recog).max(axis=1).sum())
+                for recog in organism.recognizers)
+    for k in range(len(organism.connectors)):
+        bound += float(get_gap_scores(organism, k, s_dna_len).max())
+    return bound
+
+
+def get_genome_signature(organism) -> tuple:
+    """Returns what the rows of the placement matrix depend on: the
+       signatures of the recognizers and of the connectors, and the lengths
+       of the recognizers (the connector scores depend on all of them).
+    """
+    return ([recog.get_signature() for recog in organism.recognizers],
+            [conn.get_signature() for conn in organism.connectors],
+            organism.recog_lengths)
+
+
+def get_resume_index(signature, checkpoint_signature) -> int:
+    """Returns the index of the first recognizer whose rows must be
+       recomputed, given the genome signature of the organism and the one of
+       a checkpoint. The state entering recognizer k only depends on the
+       recognizers and connectors before k, so rows can be reused up to the
+       first modified node. The state entering the first recognizer is the
+       initial one, so 0 means that nothing can be reused.
+    """
+    recog_sigs, conn_sigs, recog_lengths = signature
+    old_recog_sigs, old_conn_sigs, old_recog_lengths = checkpoint_signature
+    
+    # Any change in the lengths of the PSSMs changes all the connector scores
+    if recog_lengths != old_recog_lengths:
+        return 0
+    
+    k = 0
+    while (k < len(recog_sigs) - 1 and recog_sigs[k] == old_recog_sigs[k]
+           and conn_sigs[k] == old_conn_sigs[k]):
+        k += 1
+    return k
+
+
+def get_binding_energies(organism, sequence_block) -> list:
+    """Places the organism on all the sequences of a SequenceBlockObject and
+       returns their energies (the same values as placement.energy, in the
+       order of the sequences in the block).
+       The sequences of each group of equal length are placed together: each
+       row of the placement matrix is computed for the whole group at once.
+       
+       If the organism keeps placement checkpoints, the state of the
+       computation entering each recognizer is stored for each group, under
+       the key of its content (SequenceBlockObject.group_keys): any block
+       holding the same sequences, in the same order, finds it. When an
+       organism (or its parent, for mutated clones) already has a checkpoint
+       for a group, the computation resumes from the first modified node.
+    """
+    use_checkpoints = organism.max_placement_checkpoints > 0
+    if use_checkpoints:
+        signature = get_genome_signature(organism)
+    
+    metrics.count("placements", len(sequence_block))
+    energies = [None] * len(sequence_block)
+    # Worst-case error of the energies (approximate gap evaluation)
+    energy_error_bound = 0.0
+    for length, (indexes, codes) in sequence_block.length_groups.items():
+        group_key = sequence_block.group_keys[length]
+        states = None
+        resume = None
+        if use_checkpoints:
+            states = []
+            checkpoint = organism.get_placement_checkpoint(group_key)
+            if checkpoint is not None:
+                resume_k = get_resume_index(signature, checkpoint["signature"])
+                if resume_k > 0:
+                    states = checkpoint["states"][:resume_k]
+                    resume = checkpoint["states"][resume_k]
+                    metrics.count("checkpoint_resumes")
+        
+        exit_rows, exit_strands, gap_rows, gap_origins, error = fill_recognizer_rows(
+            organism, codes, energy_only=True, resume=resume,
+            checkpoints=states, track_key=group_key)
+        if use_checkpoints:
+            organism.set_placement_checkpoint(
+                group_key, {"signature": signature, "states": states})
+        best_scores = exit_rows[-1].max(axis=-1)
+        for idx, best in zip(indexes, best_scores):
+            energies[idx] = organism.get_energy(best)
+        energy_error_bound = max(energy_error_bound, float(error.max()))
+    
+    organism.energy_error_bound = energy_error_bound
+    return energies
+
+
+def trace_recognizer_rows(organism, codes, placement, exit_rows,
+                          exit_strands, gap_rows, gap_origins,
+                          end_col=None) -> None:
+    """Traceback over the rows returned by fill_recognizer_rows.
+       Compiles recognizer/connector scores and positions of the placement
+       object, exactly as get_node_positions_and_energies does on the full
+       matrices, and the strand each recognizer is bound to.
+       The traceback starts at column end_col of the bottom row (the best
+       placement ending there) or, if it's None, at the first best cell.
+    """
+    n = codes.shape[-1]
+    n_recognizers = organism.count_recognizers()
+
+    # Matrix column where each recognizer ends and where it starts (column of
+    # the cell preceding its first PSSM column)
+    ends = [0] * n_recognizers
+    starts = [0] * n_recognizers
+    # Strand of each recognizer
+    strands = [0] * n_recognizers
+    # Whether each connector is a gap or a 0-bp gap
+    is_gap = [False] * (n_recognizers - 1)
+
+    # Traceback starts at the first best cell of the bottom row
+    col = int(np.argmax(exit_rows[-1])) if end_col is None else int(end_col)
+    for k in range(n_recognizers - 1, -1, -1):
+        ends[k] = col
+        starts[k] = col - organism.recognizers[k].length
+        strands[k] = int(exit_strands[k][col])
+        if k > 0:
+            origin = gap_origins[k - 1][starts[k]]
+            if origin != NO_GAP:
+                is_gap[k - 1] = True
+                col = int(origin)
+            else:
+                col = starts[k]
+
+    # Node scores are the differences between cumulative scores
+    recognizers_scores = []
+    connectors_scores = []
+    connectors_starts = []
+    connectors_stops = []
+    previous_score = 0
+    for k in range(n_recognizers):
+        if k > 0:
+            if is_gap[k - 1]:
+                cumulative_score = gap_rows[k - 1][starts[k]]
+                connectors_starts.append(ends[k - 1])
+                connectors_stops.append(starts[k])
+            else:
+                # Remove the contribution of the first PSSM column from the
+                # cell, so that only the 0-bp connector score is left
+                pssm_contribution = pack_strands(organism.recognizers[k])[
+                    strands[k], 0, codes[starts[k]]]
+                zero_gap_score = get_zero_gap_score(organism, k - 1, n)
+                cell_score = gap_rows[k - 1][starts[k]] + (
+                    zero_gap_score + pssm_contribution)
+                cumulative_score = cell_score - pssm_contribution
+                connectors_starts.append(starts[k])
+                connectors_stops.append(starts[k] + 1)
+            connectors_scores.append(cumulative_score - previous_score)
+            previous_score = cumulative_score
+
+        cumulative_score = exit_rows[k][ends[k]]
+        recognizers_scores.append(cumulative_score - previous_score)
+        previous_score = cumulative_score
+
+    placement.set_recognizers(starts, ends, recognizers_scores, strands)
+    placement.set_connectors(connectors_starts, connectors_stops,
+                             connectors_scores)
@@ -6,22 +6,32 @@ Placement object
 
 import numpy as np
 
+# Strand codes of the recognizers (see PlacementObject.recognizers_strand_codes)
+STRAND_SYMBOLS = ["+", "-"]
+
 class PlacementObject:
     """
     Placement object
     
+    The nodes of the placement are stored as arrays (struct of arrays): the
+    start and stop positions and the score of each recognizer, and of each
+    connector. Positions are turned into tuples and text only when they're
+    read (recognizers_positions, print_placement).
+    
     """
     
+    __slots__ = ("organism_id", "dna_sequence", "energy", "energy_error_bound",
+                 "recognizers_starts", "recognizers_stops",
+                 "recognizers_scores", "recognizers_strand_codes",
+                 "connectors_starts", "connectors_stops", "connectors_scores")
+    
     def __init__(self, organism_id, dna_sequence):
         """
         PlacementObject object constructor.
 
         Args:
-            energy: 
-            recognizers_scores: 
-            connectors_scores: 
-            nodes_placement_right_ends: 
-            null_gaps: 
+            organism_id: ID of the placed organism
+            dna_sequence: sequence the organism is placed on
         """
         
         self.organism_id = organism_id
@@ -30,27 +40,80 @@ class PlacementObject:
         # Initialize placement features
         
         self.energy = None
-        self.recognizers_scores = []
-        self.connectors_scores = []
-        self.recognizers_positions = []
-        self.connectors_positions = []
+        # Upper bound to the error of the energy (approximate placement)
+        self.energy_error_bound = 0.0
+        self.recognizers_starts = np.zeros(0, dtype=int)
+        self.recognizers_stops = np.zeros(0, dtype=int)
+        self.recognizers_scores = np.zeros(0)
+        # Strand each recognizer is bound to (0 forward, 1 reverse
+        # complement). Compiled by the vectorized placement engine only
+        self.recognizers_strand_codes = np.zeros(0, dtype=np.int8)
+        self.connectors_starts = np.zeros(0, dtype=int)
+        self.connectors_stops = np.zeros(0, dtype=int)
+        self.connectors_scores = np.zeros(0)
     
     # Compile placement features
     
     def set_energy(self, energy):
         self.energy = energy
     
+    def set_energy_error_bound(self, error_bound):
+        self.energy_error_bound = error_bound
+    
     def set_recognizer_scores(self, recog_scores):
-        self.recognizers_scores = recog_scores
+        self.recognizers_scores = np.asarray(recog_scores, dtype=float)
     
     def set_connectors_scores(self, conn_scores):
-        self.connectors_scores = conn_scores
+        self.connectors_scores = np.asarray(conn_scores, dtype=float)
+    
+    def set_recognizers(self, starts, stops, scores, strand_codes):
+        """Sets all the recognizers at once (arrays of one element per
+           recognizer).
+        """
+        self.recognizers_starts = np.asarray(starts, dtype=int)
+        self.recognizers_stops = np.asarray(stops, dtype=int)
+        self.recognizers_scores = np.asarray(scores, dtype=float)
+        self.recognizers_strand_codes = np.asarray(strand_codes, dtype=np.int8)
+    
+    def set_connectors(self, starts, stops, scores):
+        """Sets all the connectors at once (arrays of one element per
+           connector).
+        """
+        self.connectors_starts = np.asarray(starts, dtype=int)
+        self.connectors_stops = np.asarray(stops, dtype=int)
+        self.connectors_scores = np.asarray(scores, dtype=float)
     
     def append_recognizer_position(self, recog_position):
-        self.recognizers_positions.append(recog_position)
+        start, stop = recog_position
+        self.recognizers_starts = np.append(self.recognizers_starts, start)
+        self.recognizers_stops = np.append(self.recognizers_stops, stop)
     
     def append_connector_position(self, connector_position):
-        self.connectors_positions.append(connector_position)
+        start, stop = connector_position
+        self.connectors_starts = np.append(self.connectors_starts, start)
+        self.connectors_stops = np.append(self.connectors_stops, stop)
+    
+    # Read placement features
+    
+    @property
+    def recognizers_positions(self):
+        """(start, stop) DNA positions of each recognizer."""
+        return list(zip(self.recognizers_starts.tolist(),
+                        self.recognizers_stops.tolist()))
+    
+    @property
+    def connectors_positions(self):
+        """(start, stop) DNA positions of each connector."""
+        return list(zip(self.connectors_starts.tolist(),
+                        self.connectors_stops.tolist()))
+    
+    @property
+    def recognizers_strands(self):
+        """Strand of each recognizer, as "+" or "-" (empty if the strands
+           were not compiled).
+        """
+        return [STRAND_SYMBOLS[code]
+                for code in self.recognizers_strand_codes.tolist()]
     
     # Print placement (to standard output or to file)
     
@@ -74,9 +137,8 @@ class PlacementObject:
         conn_scores_line = ["_"] * n
         
         # Recognizers positions
-        for i in range(len(self.recognizers_positions)):
+        for i, (start, stop) in enumerate(self.recognizers_positions):
             # start and stop DNA positions of recognizer i
-            start, stop = self.recognizers_positions[i]
             
             # get the recognizer score and format it
             recog_score = self.recognizers_scores[i]
@@ -92,9 +154,8 @@ class PlacementObject:
                     recog_scores_line[start + c] = recog_score_str[c]
         
         # Connectors positions
-        for i in range(len(self.connectors_positions)):
+        for i, (start, stop) in enumerate(self.connectors_positions):
             # start and stop DNA positions of connector i
-            start, stop = self.connectors_positions[i]
             
             # get the connector score and format it
             connector_score = self.connectors_scores[i]
@@ -129,30 +190,3 @@ class PlacementObject:
             print("".join(recog_positions_line), file=outfile)
             print("".join(recog_scores_line), file=outfile)
             print("".join(conn_scores_line), file=outfile)
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -0,0 +1,176 @@
+# -*- coding: utf-8 -*-
+"""
+Population engine
+Energy-only placement of a whole population at once, on the CPU or on a GPU.
+
+The placement engine places one organism at a time. This module packs the
+PSSMs and the connector tables of many organisms into padded arrays (at most
+MAX_NODES recognizers, of at most MAX_COLUMNS columns), and fills the rows of
+the placement matrices of all the organisms on all the sequences of a group
+of equal length in the same array operations: the rows have shape
+(organisms x sequences x positions). Organisms with fewer recognizers, or
+shorter PSSMs, are left unchanged by the steps they don't have.
+
+The arrays are handled by an array module with the numpy interface: numpy on
+the CPU, or CuPy on a GPU (PLACEMENT_BACKEND "gpu", see set_backend). Only
+the energies are computed: placements with traceback (exports, recombination)
+are still computed on the CPU by the placement engine.
+
+The gaps are always evaluated exactly (as with GAP_EVALUATION "full"), so
+the energies are the same as the ones of the vectorized engine with "full"
+or "banded" gap evaluation (the same floating point operations are applied
+in the same order), and never lower than the ones of the "approximate" one.
+"""
+
+import numpy as np
+from .placement_engine import pack_pssm, get_gap_scores
+from .metrics_object import metrics
+
+# Array module of the backend (numpy, or cupy on a GPU)
+xp = np
+
+
+def set_backend(name: str) -> str:
+    """Sets the array module used by the engine: "cpu" for numpy, "gpu" for
+       CuPy. If CuPy (or a GPU) is not available, the engine falls back to
+       numpy. Returns the name of the backend actually used.
+    """
+    global xp
+    if name not in ["cpu", "gpu"]:
+        raise ValueError('PLACEMENT_BACKEND should be "cpu" or "gpu".')
+    xp = np
+    if name == "gpu":
+        try:
+            import cupy  # CuPy is only imported if needed
+            cupy.zeros(1)  # fails if there's no usable device
+            xp = cupy
+        except Exception as error:
+            print("GPU backend not available ({}): placing on the CPU.".format(
+                error))
+            return "cpu"
+    return name
+
+
+def to_host(array) -> np.ndarray:
+    """Returns a numpy copy of an array of the backend.
+    """
+    if xp is np:
+        return array
+    return xp.asnumpy(array)
+
+
+def pack_population(organisms: list, s_dna_len: int) -> tuple:
+    """Packs the recognizers and the connectors of the organisms for
+       sequences of length s_dna_len.
+
+    Returns:
+        pssms: scores of the PSSM columns, of shape (strands x organisms x
+               recognizers x columns x 4). The second strand is the reverse
+               complement, -inf for the PSSMs that don't scan it
+        lengths: number of columns of each PSSM, of shape (organisms x
+                 recognizers), 0 for missing recognizers
+        gap_tables: connector scores by gap size (see get_gap_scores), of
+                    shape (organisms x connectors x s_dna_len+1)
+        n_recognizers: number of recognizers of each organism
+    """
+    n_organisms = len(organisms)
+    max_recognizers = max(org.count_recognizers() for org in organisms)
+    max_columns = max(max(org.recog_lengths) for org in organisms)
+
+    pssms = np.zeros((2, n_organisms, max_recognizers, max_columns, 4))
+    pssms[1] = -1 * np.inf
+    lengths = np.zeros((n_organisms, max_recognizers), dtype=int)
+    gap_tables = np.full((n_organisms, max(max_recognizers - 1, 1),
+                          s_dna_len + 1), -1 * np.inf)
+    n_recognizers = np.zeros(n_organisms, dtype=int)
+
+    for i, org in enumerate(organisms):
+        n_recognizers[i] = org.count_recognizers()
+        for k, recog in enumerate(org.recognizers):
+            lengths[i, k] = recog.length
+            pssms[0, i, k, :recog.length] = pack_pssm(recog)
+            if recog.scan_reverse_complement:
+                pssms[1, i, k, :recog.length] = recog.get_rc_pssm()
+        for k in range(len(org.connectors)):
+            gap_tables[i, k] = get_gap_scores(org, k, s_dna_len)
+    return pssms, lengths, gap_tables, n_recognizers
+
+
+def get_best_scores(packed: tuple, codes) -> np.ndarray:
+    """Fills the placement matrices of the packed organisms (see
+       pack_population) on a group of encoded sequences of equal length,
+       of shape (sequences x n), and returns the best score of each organism
+       on each sequence, of shape (organisms x sequences).
+    """
+    pssms, lengths, gap_tables, n_recognizers = [xp.asarray(a) for a in packed]
+    codes = xp.asarray(codes)
+    _, n_organisms, max_recognizers, max_columns, _ = pssms.shape
+    n_sequences, n = codes.shape
+
+    # First row of the placement matrices. The first PSSM can't be preceded
+    # by a 0-bp gap
+    row = xp.zeros((n_organisms, n_sequences, n + 1))
+    from_diagonal = xp.zeros(row.shape, dtype=bool)
+
+    for k in range(max_recognizers):
+        # Diagonal moves, for both strands (leading axis)
+        strand_rows = xp.broadcast_to(row, (2,) + row.shape)
+        for c in range(max_columns):
+            # PSSM column scores over the sequences
+            diag_scores = pssms[:, :, k, c, :][..., codes]
+
+            # Contiguous PSSMs (0-bp gap) get the 0-bp score of the connector
+            if c == 0 and k > 0:
+                zero_gap_scores = gap_tables[:, k - 1, 0][:, None, None]
+                diag_scores = xp.where(from_diagonal[..., :-1],
+                                       zero_gap_scores + diag_scores,
+                                       diag_scores)
+
+            new_rows = xp.empty(diag_scores.shape[:-1] + (n + 1,))
+            new_rows[..., 0] = -1 * np.inf
+            new_rows[..., 1:] = strand_rows[..., :-1] + diag_scores
+            # Only the organisms having column c in recognizer k move
+            active = (c < lengths[:, k])[:, None, None]
+            strand_rows = xp.where(active, new_rows, strand_rows)
+        # Best strand for each cell
+        row = strand_rows.max(axis=0)
+
+        # Horizontal moves (gaps) at the interface with the next PSSM
+        if k < max_recognizers - 1:
+            gap_scores = gap_tables[:, k]
+            best = xp.full(row.shape, -1 * np.inf)
+            for d in range(1, n):
+                best[..., d:] = xp.maximum(
+                    best[..., d:], row[..., :n + 1 - d] + gap_scores[:, d, None, None])
+            # Gaps replace diagonal moves if they're better or equal
+            use_gap = best >= row
+            use_gap[..., 0] = False
+            has_gap = (k < n_recognizers - 1)[:, None, None]
+            use_gap &= has_gap
+            row = xp.where(use_gap, best, row)
+            # Cells reached diagonally can be followed by a 0-bp gap
+            from_diagonal = ~use_gap
+            from_diagonal[..., 0] = False
+
+    return to_host(row.max(axis=-1))
+
+
+def get_population_energies(organisms: list, sequence_block,
+                            batch_size: int) -> list:
+    """Places the organisms on all the sequences of a SequenceBlockObject,
+       batch_size organisms at a time, and returns the energies of each
+       organism (the same lists as OrganismObject.get_binding_energies).
+    """
+    energies = [[None] * len(sequence_block) for _ in organisms]
+    metrics.count("placements", len(organisms) * len(sequence_block))
+    for length, (indexes, codes) in sequence_block.length_groups.items():
+        for first in range(0, len(organisms), batch_size):
+            batch = organisms[first:first + batch_size]
+            best_scores = get_best_scores(pack_population(batch, length), codes)
+            for i, org in enumerate(batch):
+                org_energies = energies[first + i]
+                for idx, best in zip(indexes, best_scores[i]):
+                    org_energies[idx] = org.get_energy(best)
+    for org in organisms:
+        org.energy_error_bound = 0.0
+    return energies
@@ -12,10 +12,27 @@
 """
 
 import random
+import hashlib
 import numpy as np
 import decimal as dec
 
 
+# Fixed base-index order of the columns of the PWM and PSSM arrays
+BASES = ["a", "c", "g", "t"]
+BASE_INDEX = {"a": 0, "c": 1, "g": 2, "t": 3}
+
+
+def pwm_to_array(pwm) -> np.ndarray:
+    """Returns a PWM as a (length x 4) float array, following the BASES order.
+       The input can be a list (or numpy array) of {"a","c","g","t"}
+       dictionaries, as found in the JSON files, or a (length x 4) array-like.
+    """
+    if len(pwm) > 0 and isinstance(pwm[0], dict):
+        return np.array([[column[base] for base in BASES] for column in pwm],
+                        dtype=float)
+    return np.array(pwm, dtype=float).reshape(-1, 4)
+
+
 class PssmObject():
     """PSSM object is a type of recognizer object
     """
@@ -29,14 +46,21 @@ class PssmObject():
             
 
         Args:
-            pwm (numpy.array): PWM
+            pwm: PWM, as a (length x 4) array or as a list of dictionaries
+                 (see pwm_to_array)
             config: configuration from JSON file
         """
         
         # set PSSM length and position weight matrix
-        self.length = len(pwm)  # length of the numpy array
-        self.pwm = pwm  # numpy array of dictionaries
-        self.pssm = None #scoring matrix
+        self.pwm = pwm_to_array(pwm)  # (length x 4) array, BASES order
+        self.length = len(self.pwm)  # number of columns of the PSSM
+        self.pssm = None #scoring matrix, see get_pssm
+        self.rc_pssm = None #scoring matrix of the reverse complement strand
+        # The scoring matrix is recomputed only when it's needed after the
+        # PWM has been modified
+        self.pssm_is_dirty = True
+        # Hash of the scoring matrices, see get_hash
+        self.pssm_hash = None
         
         # assign PSSM-specific configuration elements
         self.mutate_probability_random_col = config[
@@ -73,6 +97,47 @@ class PssmObject():
         
         # Compute PSSM Matrix based on PWM
         self.recalculate_pssm()
+    
+    
+    def clone(self):
+        """Returns a copy of the PSSM object. The configuration values are
+           shared, and the PWM array is copied in one go. The scoring matrices
+           are shared too: they're never modified in place (they're replaced
+           when the PWM changes).
+        """
+        new_pssm = PssmObject.__new__(PssmObject)
+        new_pssm.__dict__.update(self.__dict__)
+        new_pssm.pwm = self.pwm.copy()
+        return new_pssm
+    
+    
+    def get_pssm(self) -> np.ndarray:
+        """Returns the scoring matrix, as a (length x 4) array following the
+           BASES order. It's recomputed if the PWM has changed.
+        """
+        if self.pssm_is_dirty:
+            self.recalculate_pssm()
+        return self.pssm
+    
+    
+    def get_rc_pssm(self) -> np.ndarray:
+        """Returns the scoring matrix of the reverse complement strand: the
+           columns are in reverse order and each base is replaced by its
+           complement. Scoring a window with it gives the score of the
+           reverse complement of the window.
+           Only available if scan_reverse_complement is activated.
+        """
+        if self.pssm_is_dirty:
+            self.recalculate_pssm()
+        return self.rc_pssm
+    
+    
+    def get_pwm_dicts(self) -> list:
+        """Returns the PWM as a list of {"a","c","g","t"} dictionaries (the
+           format of the JSON files).
+        """
+        return [{base: column[BASE_INDEX[base]] for base in BASES}
+                for column in self.pwm.tolist()]
 
 
     def update_length(self):
@@ -102,6 +167,7 @@ class PssmObject():
             column_to_update = random.randint(0, self.length - 1)
             # Insert it in that position
             self.pwm[column_to_update] = new_col
+            self.pssm_is_dirty = True
         
         if random.random() < self.mutate_probability_mutate_col:
             '''Mutate a column of the PSSM. The mutation involves transferring
@@ -113,8 +179,10 @@ class PssmObject():
             donor_base, acceptor_base = random.sample(['a','c','g','t'], 2)
             
             # Current values of the two bases
-            donor_current_prob = self.pwm[idx_of_random_col][donor_base]            
-            acceptor_current_prob = self.pwm[idx_of_random_col][acceptor_base]
+            donor_idx = BASE_INDEX[donor_base]
+            acceptor_idx = BASE_INDEX[acceptor_base]
+            donor_current_prob = float(self.pwm[idx_of_random_col, donor_idx])
+            acceptor_current_prob = float(self.pwm[idx_of_random_col, acceptor_idx])
             
             no_BSs = org_factory.pwm_number_of_binding_sites
             donor_current_count = donor_current_prob * no_BSs            
@@ -142,17 +210,17 @@ class PssmObject():
             donor_new_prob = round(donor_new_prob, no_decimals)
             acceptor_new_prob = round(acceptor_new_prob, no_decimals)
             # Update pwm
-            self.pwm[idx_of_random_col][donor_base] = donor_new_prob
-            self.pwm[idx_of_random_col][acceptor_base] = acceptor_new_prob
+            self.pwm[idx_of_random_col, donor_idx] = donor_new_prob
+            self.pwm[idx_of_random_col, acceptor_idx] = acceptor_new_prob
+            self.pssm_is_dirty = True
 
         if random.random() < self.mutate_probability_flip_cols:
             # Swaps two PSSM columns
             # col1 --> col2, col2 --> col1
             col1, col2 = random.sample(range(self.length), 2)
             # Select two random columns and swap them
-            tmp_col = self.pwm[col1]
-            self.pwm[col1] = self.pwm[col2]
-            self.pwm[col2] = tmp_col
+            self.pwm[[col1, col2]] = self.pwm[[col2, col1]]
+            self.pssm_is_dirty = True
 
         if random.random() < self.mutate_probability_flip_rows:
             # Swaps two PSSM rows
@@ -163,14 +231,14 @@ class PssmObject():
             base1, base2 = bases[:2]
 
             # Swap rows
-            for i in range(self.length):
-                tmp_base = self.pwm[i][base1]
-                self.pwm[i][base1] = self.pwm[i][base2]
-                self.pwm[i][base2] = tmp_base
+            idx1, idx2 = BASE_INDEX[base1], BASE_INDEX[base2]
+            self.pwm[:, [idx1, idx2]] = self.pwm[:, [idx2, idx1]]
+            self.pssm_is_dirty = True
 
         if random.random() < self.mutate_probability_shift_left:
             # Shift PSSM from right to left, rolling over
-            self.pwm = np.roll(self.pwm, 1)
+            self.pwm = np.roll(self.pwm, 1, axis=0)
+            self.pssm_is_dirty = True
             
             # The left bound of the PSSM shifts 1 bp to the left (-1)
             pssm_displacement_code[0] -= 1
@@ -179,7 +247,8 @@ class PssmObject():
 
         if random.random() < self.mutate_probability_shift_right:
             # Shift PSSM from left to right, rolling over
-            self.pwm = np.roll(self.pwm, -1)
+            self.pwm = np.roll(self.pwm, -1, axis=0)
+            self.pssm_is_dirty = True
             
             # The left bound of the PSSM shifts 1 bp to the right (+1)
             pssm_displacement_code[0] += 1
@@ -196,22 +265,23 @@ class PssmObject():
                 # Add the new column to one side (chose randomly left or right)
                 if random.random() < 0.5:
                     # Insert to the left
-                    tmp_array = [new_col] + self.pwm.tolist()
+                    tmp_array = np.vstack([new_col, self.pwm])
                     
                     # The left bound of the PSSM shifts 1 bp to the left (-1)
                     pssm_displacement_code[0] -= 1
                     
                 else:
                     # Insert to the right
-                    tmp_array = self.pwm.tolist() + [new_col]
+                    tmp_array = np.vstack([self.pwm, new_col])
                     
                     # The right bound of the PSSM shifts 1 bp to the right (+1)
                     pssm_displacement_code[1] += 1
 
                 # assign newly made PWM
-                self.pwm = np.array(tmp_array)
+                self.pwm = tmp_array
                 # Update length attribute
                 self.update_length()
+                self.pssm_is_dirty = True
 
         if random.random() < self.mutate_probability_decrease_pwm:
             # Decrease length of PWM
@@ -234,11 +304,10 @@ class PssmObject():
                 
                 # Update length attribute
                 self.update_length()
+                self.pssm_is_dirty = True
         
-        # recompute PSSM
-        # mutation operators affect the PWM (frequency matrix)
-        # so the PSSM is re-computed after mutations take place
-        self.recalculate_pssm()
+        # mutation operators affect the PWM (frequency matrix), and set the
+        # pssm_is_dirty flag: the PSSM will be re-computed when it's needed
         
         # If the PSSM boundaries have changed, report the pssm-displacement
         # code, so that connectors can eventually be adjusted if necessary
@@ -249,36 +318,21 @@ class PssmObject():
     def recalculate_pssm(self) -> None:
         """ Calculates the PSSM based on the pwm values
         """
-        tmp_pssm = []
-        for column in self.pwm:
-            # From pwm to pssm
-            # log2(base/0.25) = log2(4.0*base)
-            decimals = 2
-            tmp_bases = []
-            # cast to float so round function does not become crazy
-            tmp_bases.append(
-                float(np.log2(4.0 * column["c"] + self.pseudo_count))
-            )
-            tmp_bases.append(
-                float(np.log2(4.0 * column["t"] + self.pseudo_count))
-            )
-            tmp_bases.append(
-                float(np.log2(4.0 * column["g"] + self.pseudo_count))
-            )
-            tmp_bases.append(
-                float(np.log2(4.0 * column["a"] + self.pseudo_count))
-            )
-
-            tmp_pssm.append(
-                {
-                    "c": round(tmp_bases[0], decimals),
-                    "t": round(tmp_bases[1], decimals),
-                    "g": round(tmp_bases[2], decimals),
-                    "a": round(tmp_bases[3], decimals),
-                }
-            )
-        # Assign re-computed PSSM
-        self.pssm = np.array(tmp_pssm)
+        # From pwm to pssm
+        # log2(base/0.25) = log2(4.0*base)
+        decimals = 2
+        log_odds = np.log2(4.0 * self.pwm + self.pseudo_count)
+        # Python's round is applied to each value (cast to float so round
+        # function does not become crazy): np.round doesn't always give the
+        # same result
+        self.pssm = np.array([[round(float(value), decimals) for value in column]
+                              for column in log_odds], dtype=float).reshape(-1, 4)
+        # The index of the complement of base index b is 3 - b, so reversing
+        # the base axis complements the bases
+        if self.scan_reverse_complement:
+            self.rc_pssm = np.ascontiguousarray(self.pssm[::-1, ::-1])
+        self.pssm_hash = None
+        self.pssm_is_dirty = False
 
 
     def get_score(self, s_dna: str) -> float:
@@ -292,7 +346,7 @@ class PssmObject():
             score is returned
         """
 
-        complement = {"a": "t", "t": "a", "g": "c", "c": "g"}
+        pssm = self.get_pssm()
         # gets a score from pssm
         score = 0
         score_reverse = float("-inf")
@@ -300,14 +354,14 @@ class PssmObject():
       
         # score given strand
         for i in range(str_length):
-            score += self.pssm[i][s_dna[i]]
+            score += pssm[i, BASE_INDEX[s_dna[i]]]
 
         # if reverse sequence scoring is activated, score reverse
         if self.scan_reverse_complement:
+            rc_pssm = self.get_rc_pssm()
             score_reverse = 0
             for i in range(str_length):
-                score_reverse += self.pssm[str_length - i - 1][
-                                 complement[s_dna[str_length - i - 1]]]
+                score_reverse += rc_pssm[i, BASE_INDEX[s_dna[i]]]
                
         # Return the max binding score
         # (only truly applies if scan_reverse_complement is activated)
@@ -317,26 +371,60 @@ class PssmObject():
             return(score)
     
 
+    def get_hash(self) -> bytes:
+        """Returns a hash of the scoring matrices: two PSSMs with the same
+           hash give the same scores on any sequence (see get_score_track).
+        """
+        pssm = self.get_pssm()
+        if self.pssm_hash is None:
+            content = hashlib.blake2b(pssm.tobytes(), digest_size=16)
+            content.update(bytes([self.scan_reverse_complement]))
+            self.pssm_hash = content.digest()
+        return self.pssm_hash
+
+    def get_score_track(self, codes: np.ndarray) -> tuple:
+        """Scores the PSSM on all the windows of encoded sequences (arrays of
+           base indexes, following the BASES order), in one pass per PSSM
+           column. Same scores as get_score on each window, strands included.
+
+        Args:
+            codes: encoded sequences, of shape (..., n)
+
+        Returns:
+            the scores of the windows starting at each offset, of shape
+            (..., n - length + 1), and the strand giving each score (0
+            forward, 1 reverse complement; the forward one on ties)
+        """
+        pssm = self.get_pssm()
+        width = max(codes.shape[-1] - self.length + 1, 0)
+        track = np.zeros(codes.shape[:-1] + (width,))
+        for i in range(self.length):
+            track = track + pssm[i][codes[..., i:i + width]]
+        strands = np.zeros(track.shape, dtype=np.int8)
+        
+        if self.scan_reverse_complement:
+            rc_pssm = self.get_rc_pssm()
+            rc_track = np.zeros(track.shape)
+            for i in range(self.length):
+                rc_track = rc_track + rc_pssm[i][codes[..., i:i + width]]
+            strands = (rc_track > track).astype(np.int8)
+            track = np.maximum(track, rc_track)
+        return track, strands
+
+    def get_signature(self) -> tuple:
+        """Returns a tuple with the scores of the PSSM, column by column, in
+           a fixed base order. Two PSSMs with the same signature always get
+           the same placements.
+        """
+        return tuple(tuple(column) for column in self.get_pssm().tolist())
+
     def print(self) -> None:
         """Print PSSM object (similar to Logo format)
            Prints a consensus sequence, with uppercase characters
            depending on user-defined threshold: upper_print_probability
         """
 
-        recognized = ""
-
-        for position in self.pwm:
-            base = "a"
-            # Find max base
-            for new_base in position.keys():
-                if position[new_base] > position[base]:
-                    base = new_base
-
-            if position[base] >= self.upper_print_probability:
-                base = base.upper()
-            recognized += base
-
-        print(recognized)
+        print(self.get_consensus())
 
     def export(self, export_file) -> None:
         """Exports pssm to a file
@@ -344,20 +432,25 @@ class PssmObject():
         Args:
             export_file: File to write the output
         """
+        export_file.write("\n" + self.get_consensus())
+
+    def get_consensus(self) -> str:
+        """Returns the consensus sequence of the PSSM, with uppercase
+           characters for the bases with probability of at least
+           upper_print_probability
+        """
         recognized = ""
 
         for position in self.pwm:
-            base = "a"
-            # Find max base
-            for new_base in position.keys():
-                if position[new_base] > position[base]:
-                    base = new_base
+            # Find max base (the first one, in BASES order, if there are ties)
+            base_idx = int(np.argmax(position))
+            base = BASES[base_idx]
             # Change to uppercase based on probability
-            if position[base] >= self.upper_print_probability:
+            if position[base_idx] >= self.upper_print_probability:
                 base = base.upper()
             recognized += base
         
-        export_file.write("\n" + recognized)
+        return recognized
 
     def is_connector(self) -> bool:
         """node is not a connector
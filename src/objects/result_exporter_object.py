@@ -0,0 +1,87 @@
+# -*- coding: utf-8 -*-
+"""
+Result exporter object
+Runs the export of results (files and plots) in a background thread.
+
+"""
+
+import threading
+import queue
+import time
+
+class ResultExporterObject:
+    """
+    Result exporter object
+
+    Export tasks (functions and their arguments) are queued and run one after
+    the other, in the order they were submitted, by a background thread. The
+    caller must hand over snapshots: objects that won't be modified after
+    submission (e.g. clones of the organisms).
+    An exception raised by a task is raised again by the next call to submit
+    or close.
+
+    """
+
+    def __init__(self, asynchronous=True):
+        """
+        ResultExporterObject object constructor.
+
+        Args:
+            asynchronous: if False, tasks are run immediately by submit (no
+                          thread is started)
+        """
+
+        self.asynchronous = asynchronous
+        self.tasks = queue.Queue()
+        self.error = None
+        # Time spent running the tasks
+        self.busy_time = 0.0
+        self.thread = None
+        if asynchronous:
+            self.thread = threading.Thread(target=self.run, daemon=True)
+            self.thread.start()
+
+    def run(self) -> None:
+        """Main loop of the background thread. A None task stops it.
+        """
+        while True:
+            task = self.tasks.get()
+            if task is None:
+                return
+            function, args = task
+            if self.error is not None:
+                # Once a task failed, the following ones are skipped
+                continue
+            start = time.perf_counter()
+            try:
+                function(*args)
+            except Exception as error:
+                self.error = error
+            self.busy_time += time.perf_counter() - start
+
+    def check_error(self) -> None:
+        """Raises the exception of the task that failed, if any.
+        """
+        if self.error is not None:
+            error = self.error
+            self.error = None
+            raise error
+
+    def submit(self, function, *args) -> None:
+        """Queues function(*args) to be run in the background.
+        """
+        self.check_error()
+        if self.asynchronous:
+            self.tasks.put((function, args))
+        else:
+            function(*args)
+
+    def close(self) -> None:
+        """Waits for all the queued tasks to be done, and stops the thread.
+        """
+        if self.thread is not None:
+            self.tasks.put(None)
+            self.thread.join()
+            self.thread = None
+        self.check_error()
+
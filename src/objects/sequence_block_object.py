@@ -0,0 +1,81 @@
+# -*- coding: utf-8 -*-
+"""
+Sequence block object
+A set of DNA sequences encoded once, to be placed in batch.
+
+"""
+
+import hashlib
+import numpy as np
+from .dataset_object import DatasetObject
+
+class SequenceBlockObject:
+    """
+    Sequence block object
+
+    The sequences are stored as a padded 2-D array of base indexes (one row
+    per sequence, following the BASES order of the placement engine) plus the
+    vector of their lengths. The connector scores depend on the length of the
+    sequence, so sequences are placed in groups of equal length: the indexes
+    and the codes of each group are prepared once, when the block is built.
+
+    The block keeps the DatasetObject its codes are copied from: sub-blocks
+    (see get_sub_block) are built from views of it, and the sequences are
+    only turned into strings when one of them is indexed.
+
+    """
+
+    def __init__(self, dna_sequences):
+        """
+        SequenceBlockObject object constructor.
+
+        Args:
+            dna_sequences: list of DNA sequences (lowercase strings), or
+                           DatasetObject (whose sequences are already
+                           encoded)
+        """
+
+        if not isinstance(dna_sequences, DatasetObject):
+            dna_sequences = DatasetObject(list(dna_sequences))
+        # Sequences of the block (indexing returns strings)
+        self.sequences = dna_sequences
+        self.lengths = np.array([dna_sequences.get_length(i)
+                                 for i in range(len(dna_sequences))], dtype=int)
+
+        # Padded block of encoded sequences
+        max_length = self.lengths.max() if len(self.lengths) > 0 else 0
+        self.codes = np.zeros((len(self.lengths), max_length), dtype=np.uint8)
+        for i in range(len(self.lengths)):
+            self.codes[i, :self.lengths[i]] = dna_sequences.get_codes(i)
+
+        # Groups of sequences of the same length: for each length, the indexes
+        # of the sequences in the block and their codes, as a contiguous
+        # (number of sequences x length) array
+        self.length_groups = {}
+        # Keys identifying the content of each group (any two groups with the
+        # same sequences, in the same order, get the same key): the score
+        # tracks of the PSSMs and the placement checkpoints are stored under
+        # them
+        self.group_keys = {}
+        for length in np.unique(self.lengths):
+            indexes = np.nonzero(self.lengths == length)[0]
+            group_codes = np.ascontiguousarray(self.codes[indexes, :length])
+            self.length_groups[int(length)] = (indexes, group_codes)
+            self.group_keys[int(length)] = (
+                group_codes.shape,
+                hashlib.blake2b(group_codes.tobytes(), digest_size=16).digest())
+
+    def __len__(self):
+        return len(self.lengths)
+
+    def get_sub_block(self, start: int, end: int):
+        """Returns the block of the sequences from start to end (excluded),
+           built from the encoded sequences of this block.
+        """
+        return SequenceBlockObject(self.sequences[start:end])
+
+    def get_total_length(self) -> int:
+        """Returns the sum of the lengths of the sequences in the block.
+        """
+        return int(self.lengths.sum())
+
@@ -0,0 +1,82 @@
+# -*- coding: utf-8 -*-
+"""
+Track store object
+
+"""
+
+import threading
+from collections import OrderedDict
+from .metrics_object import metrics
+
+class TrackStoreObject:
+    """
+    Track store object
+
+    Least-recently-used store of the score tracks of the PSSMs (see
+    PssmObject.get_score_track), used by the tracks placement engine. Keys are
+    content addresses: the hash of the PSSM (PssmObject.get_hash) and the key
+    of the sequences (SequenceBlockObject.group_keys), so the organisms of the
+    population carrying identical PSSMs share the same tracks. The store is
+    bounded by the memory taken by the tracks, and it can be shared by
+    several threads.
+
+    """
+
+    def __init__(self, max_bytes):
+        """
+        TrackStoreObject object constructor.
+
+        Args:
+            max_bytes: maximum memory taken by the stored tracks. When the
+                       store is full, the least recently used tracks are
+                       discarded
+        """
+
+        self.max_bytes = max_bytes
+        self.tracks = OrderedDict()
+        self.stored_bytes = 0
+        self.lock = threading.Lock()
+
+        # Statistics
+        self.hits = 0
+        self.misses = 0
+
+    def get(self, key):
+        """Returns the tracks stored for the key, or None if there are none.
+           The arrays are shared: they must not be modified.
+        """
+        with self.lock:
+            tracks = self.tracks.get(key)
+            if tracks is not None:
+                self.tracks.move_to_end(key)
+                self.hits += 1
+            else:
+                self.misses += 1
+        metrics.count("track_store_misses" if tracks is None
+                      else "track_store_hits")
+        return tracks
+
+    def set(self, key, tracks) -> None:
+        """Stores the tracks (a tuple of arrays) for the key. Tracks larger
+           than the whole store are not stored.
+        """
+        size = sum(array.nbytes for array in tracks)
+        if size > self.max_bytes:
+            return
+        with self.lock:
+            if key in self.tracks:
+                self.stored_bytes -= sum(array.nbytes
+                                         for array in self.tracks[key])
+            self.tracks[key] = tracks
+            self.tracks.move_to_end(key)
+            self.stored_bytes += size
+            while self.stored_bytes > self.max_bytes:
+                _, old_tracks = self.tracks.popitem(last=False)
+                self.stored_bytes -= sum(array.nbytes for array in old_tracks)
+
+    def clear(self) -> None:
+        """Discards all the stored tracks.
+        """
+        with self.lock:
+            self.tracks = OrderedDict()
+            self.stored_bytes = 0
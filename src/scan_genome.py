@@ -0,0 +1,342 @@
+# -*- coding: utf-8 -*-
+"""Scans a genome with evolved organisms
+
+The genome (FASTA file, one or more records) is memory-mapped and read in
+chunks, so memory doesn't grow with the size of the genome. Each chunk is
+tiled with overlapping windows, and the organisms imported from
+INPUT_FILENAME are placed on every window. Windows of the same length are
+placed together by the placement engine. Chunks are scanned in parallel by a
+pool of processes.
+
+Every placement of an organism having an energy (OrganismObject.get_energy)
+of at least SCAN_ENERGY_THRESHOLD is reported as a hit, in BED format (one
+line per hit, ordered by position): each cell of the bottom row of the
+placement matrix of a window above the threshold is traced back to a site,
+so a window can report several sites. Placements scoring below the energy
+threshold of the organism (whose energy is the threshold itself) are never
+hits. A site found by several windows (in their overlapping parts) is
+reported once, with its best energy. A chunk reports the sites starting
+before the part it shares with the next chunk (the other ones are reported
+by the next chunk). Windows should overlap by at least the length of the
+placements expected, otherwise hits spanning two windows can be missed.
+
+"""
+
+import mmap
+import time
+import collections
+import multiprocessing
+import numpy as np
+from search_organisms import read_json_file
+from objects.organism_factory import OrganismFactory
+from objects.placement_object import PlacementObject
+from objects import placement_engine
+
+CONFIG_FILE = "config.json"
+
+# Size of the blocks of the FASTA file read at once (bytes)
+READ_BLOCK_SIZE = 4 * 1024 * 1024
+
+# Code given by the placement engine to the characters that are not a valid
+# base (N, etc.)
+INVALID_CODE = 255
+
+# Lookup table to lowercase sequence characters
+LOWERCASE_TABLE = bytes.maketrans(b"ACGTN", b"acgtn")
+
+# Organisms placed by each process of the pool (set by init_worker)
+worker_organisms: list = []
+
+
+def get_fasta_records(genome: mmap.mmap) -> list:
+    """Returns the records of a memory-mapped FASTA file, as a list of
+       (name, first byte of the sequence, end byte of the sequence) tuples.
+       The name is the first word of the header line.
+    """
+    records = []
+    header_start = genome.find(b">")
+    while header_start != -1:
+        header_end = genome.find(b"\n", header_start)
+        if header_end == -1:
+            header_end = len(genome)
+        name = genome[header_start + 1:header_end].split()[0].decode("ascii")
+        sequence_end = genome.find(b"\n>", header_end)
+        if sequence_end == -1:
+            sequence_end = len(genome)
+        records.append((name, header_end + 1, sequence_end))
+        header_start = genome.find(b">", sequence_end)
+    return records
+
+
+def iter_sequence_chunks(genome: mmap.mmap, first_byte: int, end_byte: int,
+                         chunk_size: int, overlap: int):
+    """Reads the sequence of a FASTA record and yields it in overlapping
+       chunks of encoded bases: (position of the chunk in the sequence, codes
+       of chunk_size + overlap bases, whether it's the last chunk).
+       Line breaks are skipped; characters that are not a valid base are
+       encoded as INVALID_CODE.
+    """
+    pending = np.zeros(0, dtype=np.uint8)
+    position = 0
+    for block_start in range(first_byte, end_byte, READ_BLOCK_SIZE):
+        block_end = min(block_start + READ_BLOCK_SIZE, end_byte)
+        block = genome[block_start:block_end].translate(LOWERCASE_TABLE,
+                                                        b"\r\n \t")
+        codes = placement_engine.ASCII_TO_INDEX[np.frombuffer(block,
+                                                              dtype=np.uint8)]
+        pending = np.concatenate((pending, codes))
+
+        # Leave at least one full chunk pending, so that the last chunk can
+        # be flagged as such
+        while len(pending) > 2 * chunk_size + overlap:
+            yield position, pending[:chunk_size + overlap], False
+            pending = pending[chunk_size:]
+            position += chunk_size
+
+    while len(pending) > chunk_size + overlap:
+        yield position, pending[:chunk_size + overlap], False
+        pending = pending[chunk_size:]
+        position += chunk_size
+    yield position, pending, True
+
+
+def init_worker(config: dict) -> None:
+    """Initializes a process of the pool: imports the organisms to be placed.
+       Every process imports the same file in the same order, so the
+       organisms get the same IDs in all the processes.
+    """
+    global worker_organisms
+    organism_factory = OrganismFactory(
+        config["organism"],
+        config["organismFactory"],
+        config["connector"],
+        config["pssm"],
+        None
+    )
+    worker_organisms = organism_factory.import_organisms(
+        config["main"]["INPUT_FILENAME"])
+    for org in worker_organisms:
+        # Windows are never placed twice: don't keep placement checkpoints
+        # nor cached placements
+        org.max_placement_checkpoints = 0
+        org.placement_cache_size = 0
+
+
+def get_chunk_segments(codes: np.ndarray, window_size: int, step: int,
+                       is_last: bool) -> list:
+    """Tiles a chunk with windows, split at invalid bases.
+
+    Returns:
+        a list of (start, end) tuples: the segments [start, end) of the chunk
+        to be placed
+    """
+    n = len(codes)
+    # Windows are started only in the part of the chunk that is not shared
+    # with the next chunk
+    last_start = n - 1 if is_last else n - (window_size - step) - 1
+    segments = []
+    for start in range(0, last_start + 1, step):
+        end = min(start + window_size, n)
+        # The window is already covered by the previous one
+        if start > 0 and start + (window_size - step) >= n:
+            break
+
+        # Split the window at the invalid bases
+        invalid = np.nonzero(codes[start:end] == INVALID_CODE)[0] + start
+        bounds = [start - 1] + invalid.tolist() + [end]
+        for left, right in zip(bounds[:-1], bounds[1:]):
+            if right - (left + 1) > 0:
+                segments.append((left + 1, right))
+        if end == n:
+            break
+    return segments
+
+
+def get_hit_columns(org, bottom_row: np.ndarray, threshold: float) -> list:
+    """Returns the columns of the bottom row of a placement matrix where a
+       placement with an energy of at least threshold ends, with the energies
+       of those placements.
+    """
+    # Placements scoring below the energy threshold of the organism are not
+    # hits (get_energy gives them the threshold itself)
+    floor = -1 * np.inf
+    if org.energy_threshold_method == "organism":
+        floor = org.energy_threshold_value
+    candidates = np.nonzero((bottom_row >= floor) &
+                            (bottom_row > -1 * np.inf))[0]
+    hit_columns = []
+    for col in candidates:
+        energy = org.get_energy(bottom_row[col])
+        if energy is None:
+            energy = bottom_row[col]
+        if energy >= threshold:
+            hit_columns.append((int(col), float(energy)))
+    return hit_columns
+
+
+def scan_chunk(task: tuple) -> list:
+    """Places all the organisms on the windows of a chunk.
+
+    Args:
+        task: (record name, position of the chunk in the record, codes of the
+               chunk, whether it's the last chunk of the record, window size,
+               window step, energy threshold)
+
+    Returns:
+        the BED lines of the hits found in the chunk, ordered by position
+    """
+    name, offset, codes, is_last, window_size, step, threshold = task
+    segments = get_chunk_segments(codes, window_size, step, is_last)
+    # Sites starting in the part shared with the next chunk are reported by
+    # the next chunk
+    owned_end = len(codes) if is_last else len(codes) - (window_size - step)
+
+    # Segments of the same length are placed together
+    length_groups = collections.defaultdict(list)
+    for segment in segments:
+        length_groups[segment[1] - segment[0]].append(segment)
+
+    # Best hit on each site, by organism and recognizer positions (in the
+    # chunk)
+    hits = {}
+    for org in worker_organisms:
+        # Shortest sequence the organism can be placed on
+        min_length = sum(org.recog_lengths)
+        for length, group in length_groups.items():
+            if length < min_length:
+                continue
+            group_codes = np.stack([codes[start:end] for start, end in group])
+            bottom_rows = placement_engine.fill_recognizer_rows(
+                org, group_codes, energy_only=True)[0][-1]
+            hit_columns = [get_hit_columns(org, row, threshold)
+                           for row in bottom_rows]
+            hit_windows = [i for i in range(len(group)) if hit_columns[i]]
+            if len(hit_windows) == 0:
+                continue
+
+            # Whole placement matrices, for the traceback, only for the
+            # windows with a hit
+            exit_rows, exit_strands, gap_rows, gap_origins, _ = (
+                placement_engine.fill_recognizer_rows(
+                    org, group_codes[hit_windows]))
+            for w, i in enumerate(hit_windows):
+                start = group[i][0]
+                window_rows = [[rows[w] for rows in matrix_rows]
+                               for matrix_rows in (exit_rows, exit_strands,
+                                                   gap_rows, gap_origins)]
+                for col, energy in hit_columns[i]:
+                    placement = PlacementObject(org._id, None)
+                    placement.set_energy(energy)
+                    placement_engine.trace_recognizer_rows(
+                        org, group_codes[i], placement, *window_rows,
+                        end_col=col)
+                    positions = tuple(
+                        (start + recog_start, start + recog_end)
+                        for recog_start, recog_end
+                        in placement.recognizers_positions)
+                    if positions[0][0] >= owned_end:
+                        continue
+                    key = (org._id, positions)
+                    if key not in hits or hits[key][3] < energy:
+                        hits[key] = (offset + positions[0][0],
+                                     offset + positions[-1][1], org, energy,
+                                     start, placement)
+
+    sorted_hits = sorted(hits.values(),
+                         key=lambda hit: (hit[0], hit[2]._id, hit[1]))
+    return [get_bed_line(name, offset, *hit) for hit in sorted_hits]
+
+
+def get_bed_line(name: str, offset: int, hit_start: int, hit_end: int, org,
+                 energy: float, window_start: int, placement) -> str:
+    """Returns a hit in BED format: sequence name, start, end, organism ID,
+       energy and strand, followed by the positions (start-end) and strands
+       of the recognizers.
+    """
+    strands = placement.recognizers_strands
+    if len(strands) == 0:
+        strands = ["+"] * len(placement.recognizers_positions)
+    # The hit is on a strand only if all the recognizers are on it
+    strand = strands[0] if len(set(strands)) == 1 else "."
+    recognizers = ",".join(
+        ["{}-{}{}".format(offset + window_start + start,
+                          offset + window_start + end, recog_strand)
+         for (start, end), recog_strand in zip(placement.recognizers_positions,
+                                                strands)])
+    return "\t".join([name, str(hit_start), str(hit_end),
+                      "org_" + str(org._id), "{:.2f}".format(energy), strand,
+                      recognizers])
+
+
+def main():
+    """Main execution for the genome scan
+
+    """
+    #read configuration file
+    config = read_json_file(CONFIG_FILE)
+    conf_scan = config["scan"]
+    genome_path = (
+        config["main"]["DATASET_BASE_PATH_DIR"]
+        + conf_scan["GENOME_FILENAME"]
+    )
+    output_path = (
+        config["main"]["RESULT_TEST_BASE_PATH_DIR"]
+        + conf_scan["SCAN_OUTPUT_FILENAME"]
+    )
+    window_size = conf_scan["SCAN_WINDOW_SIZE"]
+    overlap = conf_scan["SCAN_WINDOW_OVERLAP"]
+    threshold = conf_scan["SCAN_ENERGY_THRESHOLD"]
+    n_processes = conf_scan["SCAN_PROCESSES"]
+    if n_processes is None:
+        n_processes = multiprocessing.cpu_count()
+
+    if not 0 <= overlap < window_size:
+        raise ValueError("SCAN_WINDOW_OVERLAP should be smaller than "
+                         "SCAN_WINDOW_SIZE.")
+    step = window_size - overlap
+    # Chunks contain whole steps, so that windows are placed on the same grid
+    # in all the chunks
+    chunk_size = max(1, conf_scan["SCAN_CHUNK_SIZE"] // step) * step
+
+    start_time = time.time()
+    n_hits = 0
+    n_bases = 0
+
+    with open(genome_path, "rb") as genome_file, \
+         mmap.mmap(genome_file.fileno(), 0, access=mmap.ACCESS_READ) as genome, \
+         multiprocessing.Pool(n_processes, init_worker, (config,)) as pool, \
+         open(output_path, "w") as output:
+
+        # At most two chunks per process are in flight, so memory is bounded.
+        # Results are written in the order of the chunks
+        in_flight = collections.deque()
+        max_in_flight = 2 * n_processes
+
+        def write_oldest():
+            lines = in_flight.popleft().get()
+            for line in lines:
+                output.write(line + "\n")
+            return len(lines)
+
+        for name, first_byte, end_byte in get_fasta_records(genome):
+            for offset, codes, is_last in iter_sequence_chunks(
+                    genome, first_byte, end_byte, chunk_size, overlap):
+                n_bases += len(codes) if is_last else chunk_size
+                task = (name, offset, codes.copy(), is_last, window_size,
+                        step, threshold)
+                in_flight.append(pool.apply_async(scan_chunk, (task,)))
+                if len(in_flight) >= max_in_flight:
+                    n_hits += write_oldest()
+
+        while len(in_flight) > 0:
+            n_hits += write_oldest()
+
+    elapsed = time.time() - start_time
+    print("Scanned {} bp in {:.2f}s: {} hits written to {}".format(
+        n_bases, elapsed, n_hits, output_path))
+
+
+if __name__ == "__main__":
+
+    main()
+
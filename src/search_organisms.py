@@ -8,15 +8,28 @@ This program searches for models that fit a specific motif.
 
 import time
 import random
-import copy
 import json
 import os
+import collections
+import pickle
+from concurrent.futures import ThreadPoolExecutor
 # import cProfile
 # import pstats
 # import io
 import numpy as np
-import matplotlib.pyplot as plt
+from matplotlib.figure import Figure
 from objects.organism_factory import OrganismFactory
+from objects.sequence_block_object import SequenceBlockObject
+from objects.fitness_cache_object import FitnessCacheObject
+from objects.track_store_object import TrackStoreObject
+from objects import placement_engine
+from objects import fitness_functions
+from objects import population_engine
+from objects import mpi_transport
+from objects.metrics_object import metrics
+from objects.dataset_object import DatasetObject
+from objects.result_exporter_object import ResultExporterObject
+from objects.island_migration_object import IslandMigrationObject
 from Bio import SeqIO
 
 """
@@ -37,6 +50,31 @@ MIN_ITERATIONS = 0
 MIN_FITNESS = 0
 RECOMBINATION_PROBABILITY = 0.0
 THRESHOLD = 0.0
+FITNESS_CACHE_SIZE = 0
+TRACK_STORE_SIZE_MB = 0
+MPI_PROTOCOL = ""
+TASK_CHUNK_SIZE = 0
+EVALUATION_MODE = ""
+EARLY_ABORT_CHUNK_SIZE = 0
+RACING_MIN_SEQUENCES = 0
+RACING_BATCH_SIZE = 0
+RACING_T_THRESHOLD = 0.0
+MIGRATION_INTERVAL = 0
+MIGRANTS = 0
+ASYNC_EXPORT = True
+METRICS = False
+PLACEMENT_BACKEND = ""
+NUM_THREADS = 1
+PLACEMENT_BATCH_SIZE = 0
+METRICS_FORMAT = ""
+PRINT_PLACEMENT = True
+CHECKPOINT_FILENAME = ""
+CHECKPOINT_INPUT_FILENAME = ""
+PERIODIC_CHECKPOINT = 0
+# Version of the format of the checkpoint files
+CHECKPOINT_VERSION = 2
+# Tag of the MPI messages of the tasks protocol
+TASK_TAG = 1
 
 JSON_CONFIG_FILENAME = "config.json"
 """
@@ -60,35 +98,53 @@ mean_nodes: float = 0
 mean_fitness: float = 0
 
 # Initialize datasets
-positive_dataset: list = []
-negative_dataset: list = []
+positive_dataset: DatasetObject = None
+negative_dataset: DatasetObject = None
+
+# Pool of the threads of the process (NUM_THREADS > 1), None otherwise
+thread_pool: ThreadPoolExecutor = None
 
 
 def main():
     """
     Main function for the motif seek
     """
+    global thread_pool
     
     if i_am_main_process():  # XXX
         print("Loading parameters...")
     
+    # State of the interrupted run to be resumed (see load_checkpoint)
+    checkpoint = None
+    if POPULATION_ORIGIN.lower() == "checkpoint":
+        checkpoint = load_checkpoint(CHECKPOINT_INPUT_FILENAME)
+    
     # Read positive set from specified file
-    positive_dataset = read_fasta_file(DATASET_BASE_PATH_DIR + POSITIVE_FILENAME)
+    positive_dataset = DatasetObject(
+        read_fasta_file(DATASET_BASE_PATH_DIR + POSITIVE_FILENAME))
     
     # XXX
-    if NEGATIVE_FILENAME is not None:
+    if checkpoint is not None:
+        # Datasets as they were when the checkpoint was written (the negative
+        # set may have been generated randomly)
+        positive_dataset = positive_dataset.get_view(checkpoint["positive_order"])
+        negative_dataset = checkpoint["negative_dataset"]
+    elif NEGATIVE_FILENAME is not None:
         # Read negative set from specified file
-        negative_dataset = read_fasta_file(DATASET_BASE_PATH_DIR + NEGATIVE_FILENAME)
+        negative_dataset = DatasetObject(
+            read_fasta_file(DATASET_BASE_PATH_DIR + NEGATIVE_FILENAME))
     else:
         # If no file was specified for negative set, it's generated from positive set
         if i_am_main_process():
             print("Generateing negative set...")
-            negative_dataset = generate_negative_set(positive_dataset)
+            negative_dataset = DatasetObject(
+                generate_negative_set(positive_dataset))
         else:
             negative_dataset = None  # this will only happen in parallel runs
         if RUN_MODE == 'parallel':
             # make sure all processes share the same negative set (the one of process 0)
-            negative_dataset = comm.bcast(negative_dataset, root=0)
+            negative_dataset = mpi_transport.collective(
+                comm.bcast, negative_dataset, root=0)
 
     mean_nodes = 0
     mean_fitness = 0
@@ -99,13 +155,31 @@ def main():
     """
     Generate initial population
     """
+    # Cache of the fitness values (local to each process)
+    if FITNESS_CACHE_SIZE > 0:
+        fitness_cache = FitnessCacheObject(FITNESS_CACHE_SIZE)
+    else:
+        fitness_cache = None
+    
+    # Store of the PSSM score tracks (tracks placement engine), shared by all
+    # the organisms of the process
+    if TRACK_STORE_SIZE_MB > 0:
+        placement_engine.set_track_store(
+            TrackStoreObject(TRACK_STORE_SIZE_MB * 2**20))
+    
+    # Pool of the threads evaluating the competitions within the process
+    if NUM_THREADS > 1:
+        thread_pool = ThreadPoolExecutor(NUM_THREADS)
+    
     # Instantiate organism Factory object with object configurations
     organism_factory = OrganismFactory(
         configOrganism, configOrganismFactory, configConnector, configPssm, rank
     )
     
     # Initialize the population of organisms
-    if i_am_main_process():  # XXX
+    # With the islands protocol, every process initializes its own population
+    # (of POPULATION_LENGTH organisms)
+    if i_am_main_process() or MPI_PROTOCOL == 'islands':  # XXX
         
         # Initialize list
         organism_population = []
@@ -134,24 +208,41 @@ def main():
             elif POPULATION_FILL_TYPE.lower() == "uniform":
                 # FILL the remainder of the population WITH ORGANISMS IN FILE
                 for i in range(remaining_organisms):
-                    new_organism = copy.deepcopy(
-                        file_organisms[i % len(file_organisms)]
-                    )
+                    new_organism = file_organisms[i % len(file_organisms)].clone()
                     fill_organism_population.append(new_organism)
                     new_organism.set_id(organism_factory.get_id())
             
             # join 
             organism_population = file_organisms + fill_organism_population
+        
+        elif POPULATION_ORIGIN.lower() == "checkpoint":
+            # The population of the interrupted run
+            organism_population = [
+                organism_factory.get_organism_from_compact_genome(genome)
+                for genome in checkpoint["population"]]
     
         else:
             raise Exception("Not a valid population origin, "
                 + "check the configuration file.")
         
-        print("Population size =", len(organism_population))
+        if i_am_main_process():
+            print("Population size =", len(organism_population))
     
     else:
         organism_population = None
     
+    # With the persistent protocol, the population is scattered only once: from
+    # now on, each process keeps its own sub-population
+    if RUN_MODE == 'parallel' and MPI_PROTOCOL == 'persistent':
+        organism_population = fragment_population(organism_population)
+        organism_population = mpi_transport.collective(
+            comm.scatter, organism_population, root=0)
+    # With the tasks protocol, the population stays on process 0, and the
+    # other processes only compute placements
+    if RUN_MODE == 'parallel' and MPI_PROTOCOL == 'tasks':
+        if not i_am_main_process():
+            organism_population = []
+    
     
     """
     Initialize iteration variables.
@@ -173,8 +264,65 @@ def main():
     )
     timeformat = "%Y-%m-%d--%H-%M-%S"
     
+    if checkpoint is not None:
+        iterations = checkpoint["iterations"]
+        max_score = checkpoint["max_score"]
+        last_max_score = checkpoint["last_max_score"]
+        if checkpoint["best_organism"] is not None:
+            genome, fitness, nodes = checkpoint["best_organism"]
+            best_organism = (
+                organism_factory.get_organism_from_compact_genome(genome),
+                fitness, nodes)
+        # The run continues with the random generators and the ID counter
+        # of this process as they were
+        organism_factory._organism_counter = checkpoint["organism_counter"]
+        random.setstate(checkpoint["random_state"])
+        np.random.set_state(checkpoint["numpy_random_state"])
+    
     if i_am_main_process():  # XXX
         print("Starting execution...")
+    
+    # Per-generation metrics of each process (see MetricsObject)
+    if METRICS:
+        metrics.enable("{}metrics_{}.{}".format(RESULT_BASE_PATH_DIR,
+                                                rank if rank else 0,
+                                                METRICS_FORMAT),
+                       METRICS_FORMAT)
+    
+    # With the islands protocol, the processes only exchange migrants and
+    # summaries, asynchronously
+    migration = None
+    if RUN_MODE == 'parallel' and MPI_PROTOCOL == 'islands':
+        migration = IslandMigrationObject(comm, MPI, organism_factory,
+                                          MIGRATION_INTERVAL, MIGRANTS)
+    
+    # Results are exported by process 0, in a background thread (unless
+    # ASYNC_EXPORT is false)
+    exporter = None
+    if i_am_main_process():
+        exporter = ResultExporterObject(ASYNC_EXPORT)
+    last_busy_time = 0.0
+    # Per-iteration statistics for the plots (kept across resumed runs)
+    plot_stats = {"AF": [], "MF": []}
+    if checkpoint is not None:
+        plot_stats = checkpoint["plot_stats"]
+    
+    # XXX
+    if RANDOM_SHUFFLE_SAMPLING_POS:
+        # If the dataset is shuffled, prepare a sorted version for the
+        # 'export' functions, so that regardless of the current status of
+        # the dataset, the sequences exported are always the same and
+        # always appear in the same order.
+        pos_set_for_export = sorted(positive_dataset)
+    else:
+        pos_set_for_export = positive_dataset
+
+    # With the islands protocol, each island samples its own sequences, with
+    # a random generator of its own (seeded per rank): the generations make no
+    # collective call, and the islands can stop at different generations
+    island_rng = None
+    if RUN_MODE == 'parallel' and MPI_PROTOCOL == 'islands':
+        island_rng = random.Random(random.getrandbits(32) * p + rank)
 
     # Main loop, it iterates until organisms do not get a significant change
     # or MIN_ITERATIONS or MIN_FITNESS is reached.
@@ -182,17 +330,41 @@ def main():
     while not is_finished(END_WHILE_METHOD, iterations, max_score, 
                           last_max_score):
         
+        generation_start = time.perf_counter()
+        
+        # Random generator shared by all the processes in this iteration
+        # (persistent and tasks protocols), or the one of the island (islands
+        # protocol)
+        generation_rng = island_rng
+        
+        if RUN_MODE == 'parallel' and MPI_PROTOCOL in ['persistent', 'tasks']:
+            # Only a seed is broadcast: all the processes derive from it the
+            # same permutation of the datasets (and of the population, with
+            # the persistent protocol)
+            generation_seed = random.randrange(2**32) if rank == 0 else None
+            generation_seed = mpi_transport.collective(
+                comm.bcast, generation_seed, root=0)
+            generation_rng = random.Random(generation_seed)
+        
+        if RUN_MODE == 'parallel' and MPI_PROTOCOL == 'persistent':
+            # Organisms are shuffled for deterministic crowding selection.
+            # Only the ones that move to another process are sent
+            organism_population = redistribute_population(
+                organism_population, generation_rng, organism_factory)
+        
         # XXX
-        if i_am_main_process():
+        elif i_am_main_process() or MPI_PROTOCOL == 'islands':
             # Shuffle population
             # Organisms are shuffled for deterministic crowding selection
+            # (each island shuffles its own population)
             random.shuffle(organism_population)        
         
         # XXX
-        if RUN_MODE == 'parallel':
+        if RUN_MODE == 'parallel' and MPI_PROTOCOL == 'scatter':
             # FRAGMENT AND SCATTER THE POPULATION
             organism_population = fragment_population(organism_population)
-            organism_population = comm.scatter(organism_population, root=0)
+            organism_population = mpi_transport.collective(
+                comm.scatter, organism_population, root=0)
             
             # print to check that the sub-populations are correct
             # my_ids = [org._id for org in organism_population]
@@ -201,9 +373,20 @@ def main():
         # XXX
         # Shuffle datasets (if required)
         if RANDOM_SHUFFLE_SAMPLING_POS:
-            positive_dataset = shuffle_dataset(positive_dataset)
+            positive_dataset = shuffle_dataset(positive_dataset, generation_rng)
         if RANDOM_SHUFFLE_SAMPLING_NEG:
-            negative_dataset = shuffle_dataset(negative_dataset)
+            negative_dataset = shuffle_dataset(negative_dataset, generation_rng)
+        
+        # Sequences used to evaluate the organisms in this iteration, encoded
+        # once for all the placements
+        positive_block = SequenceBlockObject(
+            positive_dataset[:MAX_SEQUENCES_TO_FIT_POS])
+        negative_block = SequenceBlockObject(
+            negative_dataset[:MAX_SEQUENCES_TO_FIT_NEG])
+        # Identifier of the sample: it only changes when the datasets are
+        # shuffled, so unshuffled runs can reuse the fitness values
+        sample_id = (iterations if RANDOM_SHUFFLE_SAMPLING_POS else 0,
+                     iterations if RANDOM_SHUFFLE_SAMPLING_NEG else 0)
         
         # Reset max_score
         last_max_score = max_score
@@ -215,265 +398,145 @@ def main():
         a_nodes = []
         
         # Deterministic crowding
-        # Iterate over pairs of organisms
-        for i in range(0, len(organism_population) - 1, 2):
-            org1 = organism_population[i]
-            org2 = organism_population[i + 1]
+        # The generation runs in three phases:
+        #  - produce: the children of all the pairs are generated
+        #  - evaluate: the fitness of all the competing organisms is computed
+        #  - compete: each parent competes with the more similar child
+        
+        competitions = get_competitions(organism_population,
+                                        positive_dataset,
+                                        organism_factory)
+        
+        # Fitness of the parent and of the child for each competition
+        # (and, with EVALUATION_MODE "racing", the number of placements each
+        # decision took)
+        decision_placements = []
+        with metrics.timer("evaluation_time"):
+            fitness_values = evaluate_competitions(
+                competitions, positive_block, negative_block, sample_id,
+                fitness_cache, organism_factory, decision_placements)
+        
+        # Make the two organisms in each pair compete
+        for (pos_idx, first_organism, second_organism), (fitness1, fitness2) in zip(
+                competitions, fitness_values):
             
-            pos_set_sample = random.sample(positive_dataset, 3)  # !!! Temporarily hardcoded number of sequences
-            ref_seq = pos_set_sample[0]
+            # Bounds to complexity
+            penalty1 = get_complexity_penalty(first_organism)
+            if penalty1 is not None:
+                fitness1 = penalty1
+            penalty2 = get_complexity_penalty(second_organism)
+            if penalty2 is not None:
+                fitness2 = penalty2
             
-            # Decide whether the parents are going to be recombined or mutated
-            if random.random() < organism_factory.recombination_probability:
-                # Recombination case; no mutation
-                child1, child2 = organism_factory.get_children(
-                    org1, org2, ref_seq, pos_set_sample
-                )
             
-            else:
-                # Non-recomination case; the children get mutated
-                child1, child2 = organism_factory.clone_parents(org1, org2)
-                # Mutate the children: the children in this non-recombination
-                # case are just a mutated versions of the parents
-                child1.mutate(organism_factory)
-                child2.mutate(organism_factory)
+            # Competition
+            if fitness1 > fitness2:  # The first organism wins (the parent wins)
+                # Set it back to the population and save fitness
+                # for next iteration
+                organism_population[pos_idx] = first_organism
+                a_fitness.append(fitness1)
+                # If the parent wins, mean_nodes don't change
+                a_nodes.append(first_organism.count_nodes())
+
+                # Check if its the max score in that iteration
+                if fitness1 > max_score:
+                    max_score = fitness1
+                    max_organism = (
+                        first_organism,
+                        fitness1,
+                        first_organism.count_nodes()
+                    )
+
+                # Check if its the max score so far and if it is set it as
+                # best organism
+                if max_organism[1] > best_organism[1]:
+                    # ID, EF, Nodes, Penalty applied
+                    best_organism = max_organism
+                    changed_best_score = True
+
+            else:  # The second organism wins (the child wins)
+                # Set it back to the population and save fitness for next
+                # iteration
+                organism_population[pos_idx] = second_organism
+                a_fitness.append(fitness2)
+                # If the child wins, update mean_nodes
+                # mean_nodes = ((meanNodes * POPULATION_LENGTH) +
+                # second_organism.count_nodes() -
+                # first_organism.count_nodes()) / POPULATION_LENGTH
+                a_nodes.append(second_organism.count_nodes())
+
+                # Check if its the max score in that iteration
+                if fitness2 > max_score:
+                    max_score = fitness2
+                    max_organism = (
+                        second_organism,
+                        fitness2,
+                        second_organism.count_nodes()
+                    )
+
+                # Check if its the max score so far and if it is set it as
+                # best organism
+                if fitness2 > best_organism[1]:
+                    # ID, EF, Nodes, Penalty applied
+                    best_organism = max_organism
+                    changed_best_score = True
+
+        
+        if RUN_MODE == 'parallel' and MPI_PROTOCOL == 'persistent':
+            # Only fitness values, numbers of nodes and the best organism of
+            # each process are gathered
+            a_fitness = mpi_transport.collective(
+                comm.gather, a_fitness, root=0)
+            a_fitness = flatten_population(a_fitness)
+            a_nodes   = mpi_transport.collective(
+                comm.gather, a_nodes, root=0)
+            a_nodes   = flatten_population(a_nodes)
             
-            # Make two pairs: each parent is paired with the more similar child
-            # (the child with higher ratio of nodes from that parent).
-            pair_children = []
-            ''' pair_children is a list of two elements. The two parents we are
-            now working with are elements i and i+1 in  organism_population.
-            We need to pair each of them with one of the two children obtained
-            with  get_children  method.
+            global_max_organism = gather_max_organism(max_organism,
+                                                      organism_factory)
+            if i_am_main_process():
+                max_organism = global_max_organism
+                max_score = max_organism[1]
+                if max_organism[1] > best_organism[1]:
+                    best_organism = max_organism
+                    changed_best_score = True
+            # All the processes must agree on when to stop
+            max_score = mpi_transport.collective(comm.bcast, max_score, root=0)
             
-                - The first element in  pair_children  will be a tuple where
-                  the first element is organism i, and the second one is a
-                  child
-                  
-                - The second element in  pair_children  will be a tuple where
-                  the first element is organism i+1, and the second one is the
-                  other child
-            '''
+            # The whole population is only needed for the periodic export
+            if iterations % PERIODIC_POP_EXPORT == 0:
+                population_for_export = gather_population(organism_population,
+                                                          organism_factory)
             
-            # get parent1/parent2 ratio for the children
-            child1_p1p2_ratio = child1.get_parent1_parent2_ratio()
-            child2_p1p2_ratio = child2.get_parent1_parent2_ratio()
+        elif RUN_MODE == 'parallel' and MPI_PROTOCOL == 'tasks':
+            # The population is only on process 0. All the processes must
+            # agree on when to stop
+            max_score = mpi_transport.collective(comm.bcast, max_score, root=0)
             
-            # If a parent gets paired with an empty child, the empty child is
-            # substituted by a deepcopy of the parent, i.e. the parent escapes
-            # competition
-            if child1_p1p2_ratio > child2_p1p2_ratio:
-                # org1 with child1
-                if child1.count_nodes() > 0:
-                    pair_children.append( (org1, child1) )
-                else:
-                    pair_children.append( (org1, copy.deepcopy(org1)) )
-                # org2 with child2
-                if child2.count_nodes() > 0:
-                    pair_children.append( (org2, child2) )
-                else:
-                    pair_children.append( (org2, copy.deepcopy(org2)) )
-            else:
-                # org1 with child2
-                if child2.count_nodes() > 0:
-                    pair_children.append( (org1, child2) )
-                else:
-                    pair_children.append( (org1, copy.deepcopy(org1)) )
-                # org2 with child1
-                if child1.count_nodes() > 0:
-                    pair_children.append( (org2, child1) )
-                else:
-                    pair_children.append( (org2, copy.deepcopy(org2)) )
+        elif RUN_MODE == 'parallel' and MPI_PROTOCOL == 'islands':
+            # No collective operation: each island stops on its own, and
+            # process 0 reports the statistics of its own island, and the
+            # best organism of all the islands
+            population_fitness = [None] * len(organism_population)
+            for (pos_idx, _, _), fitness in zip(competitions, a_fitness):
+                population_fitness[pos_idx] = fitness
+            def get_migrant_fitness(organism):
+                penalty = get_complexity_penalty(organism)
+                if penalty is not None:
+                    return penalty
+                return get_cached_fitness(organism, positive_block,
+                                          negative_block, sample_id,
+                                          fitness_cache)
             
-            # Make the two organisms in each pair compete
-            # j index is used to re insert winning organism into the population
-            for j in range(len(pair_children)):
-                '''
-                when j is 0 we are dealing with organism i
-                when j is 1 we are dealing with organism i+1
-                
-                Therefore, the winner of the competition will replace element
-                i+j in  organism_population
-                '''
-
-                first_organism = pair_children[j][0]  # Parent Organism
-                second_organism = pair_children[j][1]  # Child Organism
-                
-                # Boltzmannian fitness
-                if FITNESS_FUNCTION == "boltzmannian":
-                    performance1 = first_organism.get_boltz_fitness(positive_dataset[:MAX_SEQUENCES_TO_FIT_POS],
-                                                                    negative_dataset[:MAX_SEQUENCES_TO_FIT_NEG],
-                                                                    GENOME_LENGTH)
-                    fitness1 = performance1["score"]
-                    
-                    performance2 = second_organism.get_boltz_fitness(positive_dataset[:MAX_SEQUENCES_TO_FIT_POS],
-                                                                     negative_dataset[:MAX_SEQUENCES_TO_FIT_NEG],
-                                                                     GENOME_LENGTH)
-                    fitness2 = performance2["score"]
-                    
-                    fitness1 = round(fitness1, 8)
-                    fitness2 = round(fitness2, 8)
-                
-                # Kolmogorov fitness
-                # Computes Kolmogorov-Smirnov test on positive/negative set scores
-                elif FITNESS_FUNCTION == "kolmogorov":
-                    performance1 = first_organism.get_kolmogorov_fitness(positive_dataset[:MAX_SEQUENCES_TO_FIT_POS],
-                                                                    negative_dataset[:MAX_SEQUENCES_TO_FIT_NEG])
-                    fitness1 = performance1["score"]
-                    
-                    performance2 = second_organism.get_kolmogorov_fitness(positive_dataset[:MAX_SEQUENCES_TO_FIT_POS],
-                                                                    negative_dataset[:MAX_SEQUENCES_TO_FIT_NEG])
-
-                    fitness2 = performance2["score"]
-                    
-                    fitness1 = round(fitness1, 8)
-                    fitness2 = round(fitness2, 8)
-
-                # Discriminative fitness
-                elif FITNESS_FUNCTION == "discriminative":
-                    positive_performance1 = first_organism.get_additive_fitness(positive_dataset[:MAX_SEQUENCES_TO_FIT_POS])
-                    negative_performance1 = first_organism.get_additive_fitness(negative_dataset[:MAX_SEQUENCES_TO_FIT_NEG])
-                    p_1 = positive_performance1["score"]
-                    n_1 = negative_performance1["score"]
-                    fitness1 =  p_1 - n_1
-                    
-                    positive_performance2 = second_organism.get_additive_fitness(positive_dataset[:MAX_SEQUENCES_TO_FIT_POS])
-                    negative_performance2 = second_organism.get_additive_fitness(negative_dataset[:MAX_SEQUENCES_TO_FIT_NEG])
-                    p_2 = positive_performance2["score"]
-                    n_2 = negative_performance2["score"]
-                    fitness2 =  p_2 - n_2
-                
-                elif FITNESS_FUNCTION == "welchs":
-                    # First organism
-                    positive_performance1 = first_organism.get_additive_fitness(positive_dataset[:MAX_SEQUENCES_TO_FIT_POS])
-                    negative_performance1 = first_organism.get_additive_fitness(negative_dataset[:MAX_SEQUENCES_TO_FIT_NEG])
-                    p_1 = positive_performance1["score"]
-                    n_1 = negative_performance1["score"]
-                    
-                    # Standard deviations
-                    sigma_p_1 = positive_performance1["stdev"]
-                    sigma_n_1 = negative_performance1["stdev"]
-                    
-                    # Lower bound to sigma
-                    # (Being more consistent than that on the sets will not help
-                    # your fitness)
-                    if sigma_p_1 < 1:
-                        sigma_p_1 = 1
-                    if sigma_n_1 < 1:
-                        sigma_n_1 = 1
-                    
-                    # Standard errors
-                    sterr_p_1 = sigma_p_1 / MAX_SEQUENCES_TO_FIT_POS**(1/2)
-                    sterr_n_1 = sigma_n_1 / MAX_SEQUENCES_TO_FIT_NEG**(1/2)
-                    
-                    # Welch's t score
-                    fitness1 =  (p_1 - n_1) / (sterr_p_1**2 + sterr_n_1**2)**(1/2)
-                    
-                    # Second organism
-                    positive_performance2 = second_organism.get_additive_fitness(positive_dataset[:MAX_SEQUENCES_TO_FIT_POS])
-                    negative_performance2 = second_organism.get_additive_fitness(negative_dataset[:MAX_SEQUENCES_TO_FIT_NEG])
-                    p_2 = positive_performance2["score"]
-                    n_2 = negative_performance2["score"]
-                    
-                    # Standard deviations
-                    sigma_p_2 = positive_performance2["stdev"]
-                    sigma_n_2 = negative_performance2["stdev"]
-                    
-                    # Lower bound to sigma
-                    # (Being more consistent than that on the sets will not help
-                    # your fitness)
-                    if sigma_p_2 < 1:
-                        sigma_p_2 = 1
-                    if sigma_n_2 < 1:
-                        sigma_n_2 = 1
-                    
-                    # Standard errors
-                    sterr_p_2 = sigma_p_2 / MAX_SEQUENCES_TO_FIT_POS**(1/2)
-                    sterr_n_2 = sigma_n_2 / MAX_SEQUENCES_TO_FIT_NEG**(1/2)
-                    
-                    # Welch's t score
-                    fitness2 =  (p_2 - n_2) / (sterr_p_2**2 + sterr_n_2**2)**(1/2)
-                                    
-                else:
-                    raise Exception("Not a valid fitness function name, "
-                                    + "check the configuration file.")
-                
-                if MAX_NODES != None:  # Upper_bound to complexity
-                    
-                    if first_organism.count_nodes() > MAX_NODES:
-                        fitness1 = -1000 * int(first_organism.count_nodes())
-                    
-                    if second_organism.count_nodes() > MAX_NODES:
-                        fitness2 = -1000 * int(second_organism.count_nodes())
-
-                if MIN_NODES != None:  # Lower_bound to complexity
-                    
-                    if first_organism.count_nodes() < MIN_NODES:
-                        fitness1 = -1000 * int(first_organism.count_nodes())
-                    
-                    if second_organism.count_nodes() < MIN_NODES:
-                        fitness2 = -1000 * int(second_organism.count_nodes())
-                
-                
-                # Competition
-                if fitness1 > fitness2:  # The first organism wins (the parent wins)
-                    # Set it back to the population and save fitness
-                    # for next iteration
-                    organism_population[i + j] = first_organism
-                    a_fitness.append(fitness1)
-                    # If the parent wins, mean_nodes don't change
-                    a_nodes.append(first_organism.count_nodes())
-
-                    # Check if its the max score in that iteration
-                    if fitness1 > max_score:
-                        max_score = fitness1
-                        max_organism = (
-                            first_organism,
-                            fitness1,
-                            first_organism.count_nodes()
-                        )
-
-                    # Check if its the max score so far and if it is set it as
-                    # best organism
-                    if max_organism[1] > best_organism[1]:
-                        # ID, EF, Nodes, Penalty applied
-                        best_organism = max_organism
-                        changed_best_score = True
-
-                else:  # The second organism wins (the child wins)
-                    # Set it back to the population and save fitness for next
-                    # iteration
-                    organism_population[i + j] = second_organism
-                    a_fitness.append(fitness2)
-                    # If the child wins, update mean_nodes
-                    # mean_nodes = ((meanNodes * POPULATION_LENGTH) +
-                    # second_organism.count_nodes() -
-                    # first_organism.count_nodes()) / POPULATION_LENGTH
-                    a_nodes.append(second_organism.count_nodes())
-
-                    # Check if its the max score in that iteration
-                    if fitness2 > max_score:
-                        max_score = fitness2
-                        max_organism = (
-                            second_organism,
-                            fitness2,
-                            second_organism.count_nodes()
-                        )
-
-                    # Check if its the max score so far and if it is set it as
-                    # best organism
-                    if fitness2 > best_organism[1]:
-                        # ID, EF, Nodes, Penalty applied
-                        best_organism = max_organism
-                        changed_best_score = True
-
-                # END FOR j
-
-            # END FOR i
-        
-        if RUN_MODE == 'parallel':  # XXX
+            best_organism, changed = migration.exchange(
+                iterations, organism_population, population_fitness,
+                best_organism, get_migrant_fitness)
+            changed_best_score = changed_best_score or changed
+            
+        elif RUN_MODE == 'parallel':  # XXX
             # GATHER AND FLATTEN THE POPULATION
-            organism_population = comm.gather(organism_population, root=0)
+            organism_population = mpi_transport.collective(
+                comm.gather, organism_population, root=0)
             organism_population = flatten_population(organism_population)
             
             # print to check that the population is correct
@@ -483,9 +546,11 @@ def main():
             #     print("From process " + str(rank) + ": gathered pop is " + str(my_ids))
             
             # Also gather a_fitness and a_nodes
-            a_fitness = comm.gather(a_fitness, root=0)
+            a_fitness = mpi_transport.collective(
+                comm.gather, a_fitness, root=0)
             a_fitness = flatten_population(a_fitness)
-            a_nodes   = comm.gather(a_nodes,   root=0)
+            a_nodes   = mpi_transport.collective(
+                comm.gather, a_nodes, root=0)
             a_nodes   = flatten_population(a_nodes)
         
         if i_am_main_process():
@@ -525,38 +590,47 @@ def main():
                 RESULT_BASE_PATH_DIR + OUTPUT_FILENAME,
             )
             
-            # Print against a random positive sequence
-            pos_seq_index = random.randint(0, len(positive_dataset)-1)
-            placement = max_organism[0].get_placement(positive_dataset[pos_seq_index], traceback=True)
-            placement.print_placement(stdout = True)
+            if EVALUATION_MODE == "racing" and len(decision_placements) > 0:
+                # Decisions taken by this process
+                print_ln(
+                    "Iter: {} Races: {} Mean placements: {:.1f} Max placements: {}".format(
+                        iterations, len(decision_placements),
+                        np.mean(decision_placements), max(decision_placements)),
+                    RESULT_BASE_PATH_DIR + "racing.txt",
+                )
             
+            plot_stats["AF"].append(mean_fitness)
+            plot_stats["MF"].append(max_organism[1])
             
-            # XXX
-            if RANDOM_SHUFFLE_SAMPLING_POS:
-                # If the dataset is shuffled, prepare a sorted version for the
-                # 'export' functions, so that regardless of the current status of
-                # the dataset, the sequences exported are always the same and
-                # always appear in the same order.
-                pos_set_for_export = sorted(positive_dataset)
-            else:
-                pos_set_for_export = positive_dataset
+            # Print against a random positive sequence
+            pos_seq_index = random.randint(0, len(positive_dataset)-1)
+            if PRINT_PLACEMENT:
+                placement = max_organism[0].get_placement(positive_dataset[pos_seq_index], traceback=True)
+                placement.print_placement(stdout = True)
             
+            # The exports run in the background: they get clones of the
+            # organisms (the originals keep changing with the population)
+            export_start = time.perf_counter()
             
             # Export organism if new best organism
             if changed_best_score:
                 filename = "{}_{}".format(
                     time.strftime(timeformat), best_organism[0]._id
                 )
-                export_organism(
-                    best_organism[0], pos_set_for_export, filename, organism_factory
+                exporter.submit(
+                    export_organism,
+                    best_organism[0].clone(), pos_set_for_export, filename,
+                    organism_factory
                 )
             # Periodic organism export
             if iterations % PERIODIC_ORG_EXPORT == 0:
                 filename = "{}_{}".format(
                     time.strftime(timeformat), max_organism[0]._id
                 )
-                export_organism(
-                    max_organism[0], pos_set_for_export, filename, organism_factory
+                exporter.submit(
+                    export_organism,
+                    max_organism[0].clone(), pos_set_for_export, filename,
+                    organism_factory
                 )
             
             # Periodic population export
@@ -564,21 +638,781 @@ def main():
                 # Select a random positive DNA sequence to use for the population export
                 seq_idx = random.randint(0, len(pos_set_for_export)-1)
                 
-                export_population(
-                    organism_population, pos_set_for_export, organism_factory,
-                    iterations, seq_idx
+                if MPI_PROTOCOL == 'persistent' and RUN_MODE == 'parallel':
+                    # Already a snapshot (rebuilt from the gathered genomes)
+                    population_snapshot = population_for_export
+                else:
+                    population_snapshot = [org.clone()
+                                           for org in organism_population]
+                exporter.submit(
+                    export_population,
+                    population_snapshot, pos_set_for_export,
+                    organism_factory, iterations, seq_idx
                 )
                 
                 # Export plot, too
-                export_plots()
+                exporter.submit(export_plots, list(plot_stats["AF"]),
+                                list(plot_stats["MF"]))
+            metrics.add_time("export_time", time.perf_counter() - export_start)
         
         iterations += 1
+        
+        # Periodic checkpoint (all the processes take part)
+        if PERIODIC_CHECKPOINT > 0 and iterations % PERIODIC_CHECKPOINT == 0:
+            if RUN_MODE == 'parallel' and MPI_PROTOCOL == 'persistent':
+                population_for_checkpoint = gather_population(
+                    organism_population, organism_factory)
+            else:
+                population_for_checkpoint = organism_population
+            with metrics.timer("checkpoint_time"):
+                save_checkpoint(RESULT_BASE_PATH_DIR + CHECKPOINT_FILENAME,
+                                iterations, population_for_checkpoint,
+                                best_organism, max_score, last_max_score,
+                                plot_stats, positive_dataset,
+                                negative_dataset, organism_factory)
+        
+        # Per-generation metrics (the exporter thread reports its own time)
+        if exporter is not None:
+            metrics.add_time("background_export_time",
+                             exporter.busy_time - last_busy_time)
+            last_busy_time = exporter.busy_time
+        metrics.add_time("generation_time",
+                         time.perf_counter() - generation_start)
+        metrics.emit(iterations, rank)
         # END WHILE
+    
+    # Receive the messages still in flight (all the islands wait here)
+    if migration is not None:
+        best_organism = migration.finish(best_organism)
+    
+    # Wait for the pending exports
+    if exporter is not None:
+        exporter.close()
+    metrics.close()
+    if thread_pool is not None:
+        thread_pool.shutdown()
+        thread_pool = None
+
+
+def get_competitions(organism_population, positive_dataset,
+                     organism_factory) -> list:
+    """
+    Produce phase of deterministic crowding: generates the children of each
+    pair of organisms (i, i+1) of the population, and pairs each parent with
+    the more similar child.
+    
+    Returns:
+        the list of competitions, as (position in the population, parent,
+        child) tuples
+    """
+    
+    # Each element is (position in the population, parent, child)
+    competitions = []
+    
+    # Iterate over pairs of organisms
+    for i in range(0, len(organism_population) - 1, 2):
+        org1 = organism_population[i]
+        org2 = organism_population[i + 1]
+        
+        pos_set_sample = random.sample(positive_dataset, 3)  # !!! Temporarily hardcoded number of sequences
+        ref_seq = pos_set_sample[0]
+        
+        # Decide whether the parents are going to be recombined or mutated
+        if random.random() < organism_factory.recombination_probability:
+            # Recombination case; no mutation
+            with metrics.timer("recombination_time"):
+                child1, child2 = organism_factory.get_children(
+                    org1, org2, ref_seq, pos_set_sample
+                )
+        
+        else:
+            # Non-recomination case; the children get mutated
+            with metrics.timer("mutation_time"):
+                child1, child2 = organism_factory.clone_parents(org1, org2)
+                # Mutate the children: the children in this non-recombination
+                # case are just a mutated versions of the parents
+                child1.mutate(organism_factory)
+                child2.mutate(organism_factory)
+        
+        # Make two pairs: each parent is paired with the more similar child
+        # (the child with higher ratio of nodes from that parent).
+        pair_children = []
+        ''' pair_children is a list of two elements. The two parents we are
+        now working with are elements i and i+1 in  organism_population.
+        We need to pair each of them with one of the two children obtained
+        with  get_children  method.
+        
+            - The first element in  pair_children  will be a tuple where
+              the first element is organism i, and the second one is a
+              child
+              
+            - The second element in  pair_children  will be a tuple where
+              the first element is organism i+1, and the second one is the
+              other child
+        '''
+        
+        # get parent1/parent2 ratio for the children
+        child1_p1p2_ratio = child1.get_parent1_parent2_ratio()
+        child2_p1p2_ratio = child2.get_parent1_parent2_ratio()
+        
+        # If a parent gets paired with an empty child, the empty child is
+        # substituted by a clone of the parent, i.e. the parent escapes
+        # competition
+        if child1_p1p2_ratio > child2_p1p2_ratio:
+            # org1 with child1
+            if child1.count_nodes() > 0:
+                pair_children.append( (org1, child1) )
+            else:
+                pair_children.append( (org1, org1.clone()) )
+            # org2 with child2
+            if child2.count_nodes() > 0:
+                pair_children.append( (org2, child2) )
+            else:
+                pair_children.append( (org2, org2.clone()) )
+        else:
+            # org1 with child2
+            if child2.count_nodes() > 0:
+                pair_children.append( (org1, child2) )
+            else:
+                pair_children.append( (org1, org1.clone()) )
+            # org2 with child1
+            if child1.count_nodes() > 0:
+                pair_children.append( (org2, child1) )
+            else:
+                pair_children.append( (org2, org2.clone()) )
+        
+        # Each parent competes with its child. The winner of the
+        # competition will replace element i (first pair) or i+1 (second
+        # pair) in  organism_population
+        for j in range(len(pair_children)):
+            competitions.append((i + j, pair_children[j][0],
+                                 pair_children[j][1]))
+        
+    # END FOR i
+    
+    return competitions
+
+def get_fitness(organism, positive_block, negative_block, pos_energies=None,
+                neg_energies=None) -> float:
+    """
+    Returns the fitness of the organism on the given positive and negative
+    samples (SequenceBlockObjects), according to FITNESS_FUNCTION.
+    The binding energies on the samples can be provided, if they were already
+    computed (pos_energies, neg_energies).
+    """
+    
+    # Boltzmannian fitness
+    if FITNESS_FUNCTION == "boltzmannian":
+        performance = organism.get_boltz_fitness(positive_block, negative_block,
+                                                 GENOME_LENGTH, pos_energies,
+                                                 neg_energies)
+        fitness = round(performance["score"], 8)
+    
+    # Kolmogorov fitness
+    # Computes Kolmogorov-Smirnov test on positive/negative set scores
+    elif FITNESS_FUNCTION == "kolmogorov":
+        performance = organism.get_kolmogorov_fitness(
+            positive_block, negative_block, pos_energies=pos_energies,
+            neg_energies=neg_energies)
+        fitness = round(performance["score"], 8)
+    
+    # Discriminative and Welch's fitness (on the energy arrays, see the
+    # fitness_functions module)
+    elif FITNESS_FUNCTION in ["discriminative", "welchs"]:
+        if pos_energies is None:
+            pos_energies = organism.get_binding_energies(positive_block)
+        if neg_energies is None:
+            neg_energies = organism.get_binding_energies(negative_block)
+        if FITNESS_FUNCTION == "discriminative":
+            fitness = fitness_functions.get_discriminative_score(
+                pos_energies, neg_energies, organism.cumulative_fit_method)
+        else:
+            # Welch's t score
+            fitness = fitness_functions.get_welchs_score(
+                pos_energies, neg_energies, organism.cumulative_fit_method,
+                MAX_SEQUENCES_TO_FIT_POS, MAX_SEQUENCES_TO_FIT_NEG)
+    
+    else:
+        raise Exception("Not a valid fitness function name, "
+                        + "check the configuration file.")
+    
+    return fitness
+
+
+def get_cached_fitness(organism, positive_block, negative_block, sample_id,
+                       fitness_cache, chunks=None) -> float:
+    """
+    Same as get_fitness, but the fitness is looked up in the fitness cache
+    first (if a cache is used, i.e. fitness_cache is not None). The key is the
+    genome of the organism, the fitness function and the dataset sample.
+    If chunks (the positive and the negative chunks of the samples) are
+    given, the organism is placed chunk by chunk, as the children evaluated by
+    get_fitness_or_bound: its placement checkpoints are stored for the same
+    sequences as the ones its children look up.
+    """
+    def evaluate():
+        if chunks is None:
+            return get_fitness(organism, positive_block, negative_block)
+        pos_chunks, neg_chunks = chunks
+        pos_energies = [energy for chunk in pos_chunks
+                        for energy in organism.get_binding_energies(chunk)]
+        neg_energies = [energy for chunk in neg_chunks
+                        for energy in organism.get_binding_energies(chunk)]
+        return get_fitness(organism, positive_block, negative_block,
+                           pos_energies, neg_energies)
+    
+    if fitness_cache is None:
+        return evaluate()
+    
+    key = (organism.get_genome_hash(), FITNESS_FUNCTION, sample_id)
+    fitness = fitness_cache.get(key)
+    if fitness is None:
+        fitness = evaluate()
+        fitness_cache.set(key, fitness)
+    return fitness
+
+
+def get_complexity_penalty(organism):
+    """
+    Returns the fitness assigned to an organism violating the bounds to
+    complexity (MAX_NODES, MIN_NODES), or None if it doesn't violate them.
+    """
+    nodes = organism.count_nodes()
+    if MAX_NODES != None and nodes > MAX_NODES:  # Upper_bound to complexity
+        return -1000 * int(nodes)
+    if MIN_NODES != None and nodes < MIN_NODES:  # Lower_bound to complexity
+        return -1000 * int(nodes)
+    return None
+
+
+def can_abort_early(organism) -> bool:
+    """
+    Whether the fitness of the organism can be bounded from partial results
+    (see get_fitness_upper_bound): the fitness function must be additive
+    (discriminative or Welch's, with mean or sum as CUMULATIVE_FIT_METHOD) and
+    energies must be bounded from below (ENERGY_THRESHOLD_METHOD "organism").
+    """
+    return (FITNESS_FUNCTION in ["discriminative", "welchs"] and
+            organism.cumulative_fit_method in ["mean", "sum"] and
+            organism.energy_threshold_method == "organism")
+
+
+def get_fitness_upper_bound(organism, pos_energies, neg_energies, n_pos, n_neg,
+                            energy_bounds) -> float:
+    """
+    Returns an upper bound to the fitness (as computed by get_fitness) of an
+    organism whose energies are known only on the first sequences of the
+    samples (pos_energies out of n_pos, neg_energies out of n_neg). The
+    energies on the other sequences are bounded by energy_bounds, a
+    (lower, upper) tuple.
+    """
+    lower, upper = energy_bounds
+    # Bounds to the cumulative scores on the positive and negative samples
+    pos_upper = np.sum(pos_energies) + (n_pos - len(pos_energies)) * upper
+    neg_lower = np.sum(neg_energies) + (n_neg - len(neg_energies)) * lower
+    if organism.cumulative_fit_method == "mean":
+        pos_upper /= n_pos
+        neg_lower /= n_neg
+    difference = pos_upper - neg_lower
+    
+    if FITNESS_FUNCTION == "discriminative":
+        return difference
+    
+    # Welch's t score: the standard deviations have lower bound 1 and, for
+    # values within [lower, upper], upper bound (upper - lower) / 2
+    if difference >= 0:
+        sigma_p, sigma_n = 1, 1
+    else:
+        sigma_p = sigma_n = max(1, (upper - lower) / 2)
+    sterr_p = sigma_p / MAX_SEQUENCES_TO_FIT_POS**(1/2)
+    sterr_n = sigma_n / MAX_SEQUENCES_TO_FIT_NEG**(1/2)
+    return difference / (sterr_p**2 + sterr_n**2)**(1/2)
+
+
+def get_fitness_or_bound(organism, target, pos_chunks, neg_chunks,
+                         positive_block, negative_block) -> tuple:
+    """
+    Places the organism on the chunks of the samples (positive and negative
+    chunks alternately) until either all of them are placed or an upper bound
+    to its fitness is lower than target.
+    
+    Returns:
+        (fitness, True) if the organism was evaluated on all the sequences,
+        or (upper bound to the fitness, False) if it was abandoned
+    """
+    lengths = np.concatenate((positive_block.lengths, negative_block.lengths))
+    energy_bounds = organism.get_energy_bounds(lengths)
+    pos_energies = []
+    neg_energies = []
+    for i in range(max(len(pos_chunks), len(neg_chunks))):
+        if i < len(pos_chunks):
+            pos_energies += organism.get_binding_energies(pos_chunks[i])
+        if i < len(neg_chunks):
+            neg_energies += organism.get_binding_energies(neg_chunks[i])
+        bound = get_fitness_upper_bound(organism, pos_energies, neg_energies,
+                                        len(positive_block), len(negative_block),
+                                        energy_bounds)
+        if bound < target:
+            return bound, False
+    fitness = get_fitness(organism, positive_block, negative_block,
+                          pos_energies, neg_energies)
+    return fitness, True
+
+
+def evaluate_competitions_early_abort(competitions, positive_block,
+                                      negative_block, sample_id,
+                                      fitness_cache) -> list:
+    """
+    Same as evaluate_competitions, but the children are evaluated
+    incrementally, and abandoned as soon as they can't beat their parent (the
+    child loses if its fitness is lower than the one of the parent). For the
+    abandoned children, the fitness returned is an upper bound, which is not
+    stored in the fitness cache.
+    Organisms violating the bounds to complexity get their penalty without
+    being placed.
+    """
+    pos_chunks = split_sequence_block(positive_block, EARLY_ABORT_CHUNK_SIZE)
+    neg_chunks = split_sequence_block(negative_block, EARLY_ABORT_CHUNK_SIZE)
+    
+    def evaluate(competition):
+        _, parent, child = competition
+        parent_fitness = get_complexity_penalty(parent)
+        if parent_fitness is None:
+            # Placed on the same chunks as the child, which resumes from the
+            # checkpoints of the parent
+            parent_fitness = get_cached_fitness(parent, positive_block,
+                                                negative_block, sample_id,
+                                                fitness_cache,
+                                                (pos_chunks, neg_chunks))
+        
+        child_fitness = get_complexity_penalty(child)
+        if child_fitness is None and fitness_cache is not None:
+            key = (child.get_genome_hash(), FITNESS_FUNCTION, sample_id)
+            child_fitness = fitness_cache.get(key)
+        if child_fitness is None:
+            if can_abort_early(child):
+                child_fitness, complete = get_fitness_or_bound(
+                    child, parent_fitness, pos_chunks, neg_chunks,
+                    positive_block, negative_block)
+            else:
+                child_fitness = get_fitness(child, positive_block,
+                                            negative_block)
+                complete = True
+            if complete and fitness_cache is not None:
+                fitness_cache.set(key, child_fitness)
+        
+        return parent_fitness, child_fitness
+    
+    return map_competitions(evaluate, competitions)
+
+
+def get_racing_stages(sequence_block) -> list:
+    """
+    Splits a SequenceBlockObject for the racing evaluation: the first
+    RACING_MIN_SEQUENCES sequences, then batches of RACING_BATCH_SIZE.
+    
+    Returns:
+        for each stage, the block of the sequences added at that stage and
+        the block of all the sequences up to that stage
+    """
+    n_sequences = len(sequence_block)
+    ends = list(range(RACING_MIN_SEQUENCES, n_sequences, RACING_BATCH_SIZE))
+    ends.append(n_sequences)
+    stages = []
+    start = 0
+    for end in ends:
+        stages.append((sequence_block.get_sub_block(start, end),
+                       sequence_block.get_sub_block(0, end)))
+        start = end
+    return stages
+
+
+def is_race_decided(parent_energies, child_energies) -> bool:
+    """
+    Whether the difference between two organisms evaluated on the same
+    sequences is significant. Energies are paired by sequence: the
+    difference between the child and the parent on the positive sequences,
+    minus the one on the negative sequences, is compared to its standard
+    error (as in Welch's t score), against RACING_T_THRESHOLD. Organisms
+    whose differences don't vary at all are told apart (or found equal)
+    right away.
+    
+    Args:
+        parent_energies, child_energies: (positive energies, negative
+                                         energies) of each organism
+    """
+    pos_diff = np.array(child_energies[0]) - np.array(parent_energies[0])
+    neg_diff = np.array(child_energies[1]) - np.array(parent_energies[1])
+    if len(pos_diff) < 2 or len(neg_diff) < 2:
+        return False
+    difference = pos_diff.mean() - neg_diff.mean()
+    sterr = (pos_diff.var(ddof=1) / len(pos_diff) +
+             neg_diff.var(ddof=1) / len(neg_diff))**(1/2)
+    if sterr == 0:
+        return True
+    return abs(difference) / sterr >= RACING_T_THRESHOLD
+
+
+def race(parent, child, pos_stages, neg_stages) -> tuple:
+    """
+    Evaluates a parent and a child on growing samples (see
+    get_racing_stages), until their difference is significant (see
+    is_race_decided) or the samples are exhausted. The race only decides
+    the winner: if it's decided early, the winner (the fitter organism on
+    the sample used for the decision, the child on a tie) is then placed on
+    the rest of the sequences.
+    
+    Returns:
+        (parent fitness, child fitness, number of placements of the
+        decision, whether each fitness was computed on the whole samples).
+        The fitness of the winner is always the one on the whole samples.
+        The fitness of a loser of an early decision is the one on the sample
+        used for the decision, lowered below the one of the winner if needed
+        (it only tells that it lost)
+    """
+    organisms = [parent, child]
+    energies = [([], []), ([], [])]  # (positive, negative) of each organism
+    n_stages = max(len(pos_stages), len(neg_stages))
+    for i in range(n_stages):
+        for side, stages in enumerate([pos_stages, neg_stages]):
+            if i < len(stages):
+                for organism, org_energies in zip(organisms, energies):
+                    org_energies[side].extend(
+                        organism.get_binding_energies(stages[i][0]))
+        if is_race_decided(energies[0], energies[1]):
+            break
+    
+    pos_sample = pos_stages[min(i, len(pos_stages) - 1)][1]
+    neg_sample = neg_stages[min(i, len(neg_stages) - 1)][1]
+    fitness_values = [
+        get_fitness(organism, pos_sample, neg_sample, pos_energies,
+                    neg_energies)
+        for organism, (pos_energies, neg_energies) in zip(organisms,
+                                                          energies)]
+    placements = 2 * (len(pos_sample) + len(neg_sample))
+    if i == n_stages - 1:
+        return fitness_values[0], fitness_values[1], placements, (True, True)
+    
+    # Early decision: the winner is evaluated on the whole samples
+    winner = 1 if fitness_values[1] >= fitness_values[0] else 0
+    loser = 1 - winner
+    for side, stages in enumerate([pos_stages, neg_stages]):
+        for stage in stages[i + 1:]:
+            energies[winner][side].extend(
+                organisms[winner].get_binding_energies(stage[0]))
+    fitness_values[winner] = get_fitness(
+        organisms[winner], pos_stages[-1][1], neg_stages[-1][1],
+        energies[winner][0], energies[winner][1])
+    # The parent wins only if it's strictly fitter (as in the competition)
+    if winner == 0 and fitness_values[loser] >= fitness_values[winner]:
+        fitness_values[loser] = np.nextafter(fitness_values[winner], -np.inf)
+    elif winner == 1 and fitness_values[loser] > fitness_values[winner]:
+        fitness_values[loser] = fitness_values[winner]
+    complete = (winner == 0, winner == 1)
+    return fitness_values[0], fitness_values[1], placements, complete
+
+
+def evaluate_competitions_racing(competitions, positive_block, negative_block,
+                                 sample_id, fitness_cache,
+                                 decision_placements) -> list:
+    """
+    Same as evaluate_competitions, but each parent and its child are raced
+    (see race): they're placed on the same growing samples until one is
+    significantly better than the other. The fitness of the winner is the one
+    on the whole samples, so the statistics and the best organism of the run
+    never use a fitness computed on part of the samples. The fitness of the
+    loser of an early decision is only used to decide the competition; only
+    the ones computed on the whole samples are stored in the fitness cache.
+    The number of placements of each decision is appended to
+    decision_placements.
+    Organisms violating the bounds to complexity are not raced.
+    """
+    pos_stages = get_racing_stages(positive_block)
+    neg_stages = get_racing_stages(negative_block)
+    
+    # Each evaluation returns the fitness pair and the number of placements
+    # of the race (None if there was no race)
+    def evaluate(competition):
+        _, parent, child = competition
+        parent_fitness = get_complexity_penalty(parent)
+        child_fitness = get_complexity_penalty(child)
+        if parent_fitness is not None or child_fitness is not None:
+            if parent_fitness is None:
+                parent_fitness = get_cached_fitness(
+                    parent, positive_block, negative_block, sample_id,
+                    fitness_cache)
+            if child_fitness is None:
+                child_fitness = get_cached_fitness(
+                    child, positive_block, negative_block, sample_id,
+                    fitness_cache)
+            return (parent_fitness, child_fitness), None
+        
+        placements = None
+        keys = [(organism.get_genome_hash(), FITNESS_FUNCTION, sample_id)
+                for organism in [parent, child]]
+        if fitness_cache is not None:
+            parent_fitness = fitness_cache.get(keys[0])
+            child_fitness = fitness_cache.get(keys[1])
+        if parent_fitness is None or child_fitness is None:
+            parent_fitness, child_fitness, placements, complete = race(
+                parent, child, pos_stages, neg_stages)
+            if fitness_cache is not None:
+                for key, fitness, is_complete in zip(
+                        keys, [parent_fitness, child_fitness], complete):
+                    if is_complete:
+                        fitness_cache.set(key, fitness)
+        
+        return (parent_fitness, child_fitness), placements
+    
+    fitness_values = []
+    for fitness_pair, placements in map_competitions(evaluate, competitions):
+        fitness_values.append(fitness_pair)
+        if placements is not None:
+            decision_placements.append(placements)
+    return fitness_values
+
+
+def evaluate_competitions(competitions, positive_block, negative_block,
+                          sample_id, fitness_cache, factory,
+                          decision_placements=None) -> list:
+    """
+    Returns the (parent fitness, child fitness) pair for each competition
+    (a (position, parent, child) tuple).
+    With the tasks protocol, the placements are distributed over all the
+    processes (see run_task_scheduler): this function must be called by all
+    of them, and the processes other than 0 (which have no competitions) serve
+    placement tasks until process 0 is done.
+    With EVALUATION_MODE "early_abort" or "racing" (not available with the
+    tasks protocol), see evaluate_competitions_early_abort and
+    evaluate_competitions_racing (decision_placements is the list the
+    placements of each race are appended to).
+    """
+    if RUN_MODE != 'parallel' or MPI_PROTOCOL != 'tasks':
+        if EVALUATION_MODE == "early_abort":
+            return evaluate_competitions_early_abort(
+                competitions, positive_block, negative_block, sample_id,
+                fitness_cache)
+        if EVALUATION_MODE == "racing":
+            if decision_placements is None:
+                decision_placements = []
+            return evaluate_competitions_racing(
+                competitions, positive_block, negative_block, sample_id,
+                fitness_cache, decision_placements)
+        if PLACEMENT_BACKEND == "gpu":
+            return evaluate_competitions_batched(
+                competitions, positive_block, negative_block, sample_id,
+                fitness_cache)
+        return map_competitions(
+            lambda competition: (
+                get_cached_fitness(competition[1], positive_block,
+                                   negative_block, sample_id, fitness_cache),
+                get_cached_fitness(competition[2], positive_block,
+                                   negative_block, sample_id, fitness_cache)),
+            competitions)
+    
+    # Units of work: blocks of TASK_CHUNK_SIZE sequences of each sample
+    chunks = [split_sequence_block(positive_block, TASK_CHUNK_SIZE),
+              split_sequence_block(negative_block, TASK_CHUNK_SIZE)]
+    
+    if not i_am_main_process():
+        serve_tasks(chunks, factory)
+        return []
+    
+    fitness_by_hash, to_evaluate = get_organisms_to_evaluate(
+        competitions, sample_id, fitness_cache)
+    organisms = list(to_evaluate.values())
+    energies = run_task_scheduler(organisms, chunks, factory)
+    return get_competitions_fitness(competitions, positive_block,
+                                    negative_block, sample_id, fitness_cache,
+                                    fitness_by_hash, to_evaluate, energies)
+
+
+def map_competitions(function, competitions) -> list:
+    """
+    Returns the result of function on each competition, in the order of the
+    competitions. With NUM_THREADS > 1 the competitions are evaluated by the
+    threads of the pool of the process (parent and child of a competition are
+    evaluated by the same thread). The placements release the interpreter
+    lock in the numpy operations, and the datasets, the caches and the
+    connector tables are shared by the threads. A child can read the
+    placement checkpoints of a parent evaluated by another thread: they're
+    only replaced whole, and resuming from them gives the same energies.
+    """
+    if thread_pool is None:
+        return [function(competition) for competition in competitions]
+    return list(thread_pool.map(function, competitions))
+
+
+def get_organisms_to_evaluate(competitions, sample_id, fitness_cache) -> tuple:
+    """
+    Returns the fitness of the organisms of the competitions found in the
+    fitness cache (by genome hash), and the organisms to be placed: one per
+    genome, if not in the cache (by genome hash, in the order of the
+    competitions).
+    """
+    fitness_by_hash = {}
+    to_evaluate = {}
+    for _, parent, child in competitions:
+        for organism in [parent, child]:
+            genome_hash = organism.get_genome_hash()
+            if genome_hash in fitness_by_hash or genome_hash in to_evaluate:
+                continue
+            fitness = None
+            if fitness_cache is not None:
+                fitness = fitness_cache.get(
+                    (genome_hash, FITNESS_FUNCTION, sample_id))
+            if fitness is None:
+                to_evaluate[genome_hash] = organism
+            else:
+                fitness_by_hash[genome_hash] = fitness
+    return fitness_by_hash, to_evaluate
+
+
+def get_competitions_fitness(competitions, positive_block, negative_block,
+                             sample_id, fitness_cache, fitness_by_hash,
+                             to_evaluate, energies) -> list:
+    """
+    Computes the fitness of the organisms to evaluate from their (positive,
+    negative) energies (stored in the fitness cache, if used), and returns the
+    (parent fitness, child fitness) pair for each competition (see
+    get_organisms_to_evaluate).
+    """
+    for genome_hash, organism, (pos_energies, neg_energies) in zip(
+            to_evaluate.keys(), to_evaluate.values(), energies):
+        fitness = get_fitness(organism, positive_block, negative_block,
+                              pos_energies, neg_energies)
+        fitness_by_hash[genome_hash] = fitness
+        if fitness_cache is not None:
+            fitness_cache.set((genome_hash, FITNESS_FUNCTION, sample_id),
+                              fitness)
+    
+    return [(fitness_by_hash[parent.get_genome_hash()],
+             fitness_by_hash[child.get_genome_hash()])
+            for _, parent, child in competitions]
+
+
+def evaluate_competitions_batched(competitions, positive_block,
+                                  negative_block, sample_id,
+                                  fitness_cache) -> list:
+    """
+    Same as evaluate_competitions (EVALUATION_MODE "full"), but all the
+    organisms to be evaluated are placed together by the population engine,
+    PLACEMENT_BATCH_SIZE organisms at a time (PLACEMENT_BACKEND "gpu").
+    """
+    fitness_by_hash, to_evaluate = get_organisms_to_evaluate(
+        competitions, sample_id, fitness_cache)
+    organisms = list(to_evaluate.values())
+    energies = []
+    if len(organisms) > 0:
+        energies = zip(
+            population_engine.get_population_energies(
+                organisms, positive_block, PLACEMENT_BATCH_SIZE),
+            population_engine.get_population_energies(
+                organisms, negative_block, PLACEMENT_BATCH_SIZE))
+    return get_competitions_fitness(competitions, positive_block,
+                                    negative_block, sample_id, fitness_cache,
+                                    fitness_by_hash, to_evaluate, energies)
+
+
+def split_sequence_block(sequence_block, chunk_size) -> list:
+    """
+    Splits a SequenceBlockObject into blocks of (at most) chunk_size
+    sequences, in the same order.
+    """
+    return [sequence_block.get_sub_block(start, start + chunk_size)
+            for start in range(0, len(sequence_block), chunk_size)]
+
+
+def run_task_scheduler(organisms, chunks, factory) -> list:
+    """
+    Computes the binding energies of the organisms on all the chunks of the
+    positive and negative samples, distributing the (organism, chunk) tasks
+    dynamically over the processes (tasks protocol, process 0).
+    Tasks are handed out from the most expensive (estimated as the sum of the
+    PSSM lengths times the length of the chunk) to the cheapest, every time a
+    process asks for work, so that the load is balanced by actual cost rather
+    than by number of organisms. Process 0 also computes tasks, when no other
+    process is waiting.
+    Returns, for each organism, the lists of the energies on the positive and
+    on the negative sample.
+    """
+    tasks = []
+    for org_idx, organism in enumerate(organisms):
+        org_cost = organism.sum_pssm_lengths()
+        for set_idx in range(len(chunks)):
+            for chunk_idx, chunk in enumerate(chunks[set_idx]):
+                cost = org_cost * chunk.get_total_length()
+                tasks.append((cost, org_idx, set_idx, chunk_idx))
+    tasks.sort(key=lambda task: task[0], reverse=True)
+    pending = collections.deque(tasks)
+    
+    # Energies of each organism on each chunk
+    results = [[[None] * len(set_chunks) for set_chunks in chunks]
+               for _ in organisms]
+    # Organisms already sent to each process (genomes are sent only once)
+    sent_genomes = set()
+    
+    active_workers = p - 1
+    while active_workers > 0 or len(pending) > 0:
+        if len(pending) > 0 and not comm.Iprobe(source=MPI.ANY_SOURCE,
+                                                tag=TASK_TAG):
+            # Nobody is waiting: process 0 takes the cheapest task
+            _, org_idx, set_idx, chunk_idx = pending.pop()
+            results[org_idx][set_idx][chunk_idx] = (
+                organisms[org_idx].get_binding_energies(
+                    chunks[set_idx][chunk_idx]))
+            continue
+        
+        status = MPI.Status()
+        message = mpi_transport.recv(comm, MPI.ANY_SOURCE, TASK_TAG, status)
+        worker = status.Get_source()
+        if message is not None:
+            org_idx, set_idx, chunk_idx, chunk_energies = message
+            results[org_idx][set_idx][chunk_idx] = chunk_energies
+        
+        if len(pending) > 0:
+            _, org_idx, set_idx, chunk_idx = pending.popleft()
+            genome = None
+            if (worker, org_idx) not in sent_genomes:
+                genome = factory.get_compact_genome(organisms[org_idx])
+                sent_genomes.add((worker, org_idx))
+            mpi_transport.send(comm, (org_idx, set_idx, chunk_idx, genome),
+                               worker, TASK_TAG)
+        else:
+            # No more work in this generation
+            mpi_transport.send(comm, None, worker, TASK_TAG)
+            active_workers -= 1
+    
+    # Join the energies of the chunks
+    return [[sum(set_results, []) for set_results in org_results]
+            for org_results in results]
 
 
-def shuffle_dataset(dataset: list) -> list:
+def serve_tasks(chunks, factory) -> None:
+    """
+    Computes placement tasks sent by process 0 (see run_task_scheduler) until
+    there is no more work in the generation.
+    """
+    organisms = {}
+    # Ask for work
+    mpi_transport.send(comm, None, 0, TASK_TAG)
+    while True:
+        task = mpi_transport.recv(comm, 0, TASK_TAG)
+        if task is None:
+            break
+        org_idx, set_idx, chunk_idx, genome = task
+        if genome is not None:
+            organisms[org_idx] = factory.get_organism_from_compact_genome(genome)
+        chunk_energies = organisms[org_idx].get_binding_energies(
+            chunks[set_idx][chunk_idx])
+        mpi_transport.send(comm, (org_idx, set_idx, chunk_idx, chunk_energies),
+                           0, TASK_TAG)
+
+
+def shuffle_dataset(dataset: DatasetObject, rng=None) -> DatasetObject:
     '''
-    Returns the dataset (list of DNA sequences) in random order. Instead of
+    Returns the dataset (DatasetObject) in random order, as a view sharing the
+    encoded sequences with the input dataset. Instead of
     directly shuffling the list, the indexes are shuffled. This is done to
     minimize the amount of MPI communication when the program is run in
     parallel mode. Indeed, we want all the processes to compute fitness on the
@@ -586,14 +1420,21 @@ def shuffle_dataset(dataset: list) -> list:
     processes to share the same random permutation of the datset. This function
     ensures that by MPI broadcasting the indexes that define the permutation,
     instead of broadcasting the shuffled dataset of sequences.
+    
+    If a random generator is provided (rng), the permutation is generated with
+    it and no communication is needed: either all the processes share the
+    generator, or (islands protocol) each island samples its own sequences.
     '''
     indexes = list(range(len(dataset)))
+    if rng is not None:
+        rng.shuffle(indexes)
+        return dataset.get_view(indexes)
     random.shuffle(indexes)
     if RUN_MODE == 'parallel':
         # In parallel runs, the order is the one generated by process 0
-        indexes = comm.bcast(indexes, root=0)
+        indexes = mpi_transport.collective(comm.bcast, indexes, root=0)
     # Sort dataset according to indexes
-    return [dataset[i] for i in indexes]
+    return dataset.get_view(indexes)
 
 
 def get_all_kmers(seq: str, kmer_len: int) -> list:
@@ -738,71 +1579,60 @@ def export_population(
         population_dir, population_name + ".json"
     )
     
-    for organism in population:
-        # Compile the file with all the organisms of the population printed
-        organism.export(population_txt_file)
-        
-        # Compile the file with all the organisms of the population placed
-        # Write organism ID
-        placements_file = open(population_placements_file, "a+")
-        placements_file.write("***** Organism {} *****\t".format(organism._id))
-        # Write who is parent 1
-        placements_file.write("p1:")
-        placements_file.write(str(organism.assembly_instructions['p1']))
-        # Write who is parent 2
-        placements_file.write(", p2:")
-        placements_file.write(str(organism.assembly_instructions['p2']))
-        placements_file.write("\n")
-        placements_file.close()
-        # Write organism placement on a single positive sequence
-        organism.export_results([dataset[dna_seq_idx]], population_placements_file)
+    # Each file is opened once, and written in one pass
+    with open(population_txt_file, "a+") as txt_file, \
+         open(population_placements_file, "a+") as placements_file:
+        for organism in population:
+            # Compile the file with all the organisms of the population printed
+            organism.write_export(txt_file)
+            
+            # Compile the file with all the organisms of the population placed
+            # Write organism ID
+            placements_file.write("***** Organism {} *****\t".format(organism._id))
+            # Write who is parent 1
+            placements_file.write("p1:")
+            placements_file.write(str(organism.assembly_instructions['p1']))
+            # Write who is parent 2
+            placements_file.write(", p2:")
+            placements_file.write(str(organism.assembly_instructions['p2']))
+            placements_file.write("\n")
+            # Write organism placement on a single positive sequence
+            organism.write_results([dataset[dna_seq_idx]], placements_file)
     
     # Make a file with all the organisms exported in json format
     factory.export_organisms(population, population_json_file)
 
 
-def export_plots() -> None:
+def export_plots(AF_list: list, MF_list: list) -> None:
     """
     Exports:
         A plot showing the trend in the fitness of the maximum organism and the
         trend in the average fitness.
     
     Saved as png in the 'plots' subfolder in the simulation directory.
+    
+    Args:
+        AF_list: average fitness of each iteration
+        MF_list: fitness of the maximum organism of each iteration
+    
+    The figure is drawn without pyplot, so that it can be exported from the
+    background thread of the exporter.
     """
     
     plots_dir = RESULT_BASE_PATH_DIR + "plots"
     
-    # The stats are taken from the 'output.txt' file in the simulation directory
-    output_file = RESULT_BASE_PATH_DIR + 'output.txt'
-    
-    # Read the output.txt file
-    f = open(output_file, 'r')
-    lines = f.readlines()
-    f.close()
-    
-    # Parse stats into lists
-    AF_list = []
-    MF_list = []
-    GF_list = []
-    for l in lines:
-        AF = l.split('AF:')[1].split(' ')[0]
-        AF_list.append(float(AF))
-        MF = l.split('MF: ')[1].split(' ')[0]
-        MF_list.append(float(MF))
-        GF = l.split('GF:')[1].split(' ')[0]
-        GF_list.append(float(GF))
-    
     # Ignore negative values
     AF_trunc_list = [x if x>=0 else None for x in AF_list]
     MF_trunc_list = [x if x>=0 else None for x in MF_list]
     
     # Plot together AF and MF
-    plt.plot(AF_trunc_list, label="Average fitness")
-    plt.plot(MF_trunc_list, label="Fitness of max org")
-    plt.legend()
+    figure = Figure()
+    axes = figure.subplots()
+    axes.plot(AF_trunc_list, label="Average fitness")
+    axes.plot(MF_trunc_list, label="Fitness of max org")
+    axes.legend()
     filepath = os.path.join(plots_dir, "AF-MF.png")
-    plt.savefig(filepath)
-    plt.close()
+    figure.savefig(filepath)
 
 
 def i_am_main_process():
@@ -815,7 +1645,12 @@ def i_am_main_process():
 def check_mpi_settings():
     ''' If the number of processes exceeds the number of pairs of organisms in
     the population, some processes will be left with an empty population. In
-    that case, to avoid wasting computing power, an error is raised. '''
+    that case, to avoid wasting computing power, an error is raised.
+    With the tasks protocol the work is split by placement, not by pair of
+    organisms, so any number of processes can be used. With the islands
+    protocol each process has a whole population of its own. '''
+    if MPI_PROTOCOL in ['tasks', 'islands']:
+        return
     if p > int(POPULATION_LENGTH / 2):
         raise ValueError("The minimum number of organisms assigned to each " +
                          "process is 2 (you need a pair for recombination events " +
@@ -864,6 +1699,27 @@ def set_up():
     global MIN_ITERATIONS
     global MIN_FITNESS
     global THRESHOLD
+    global FITNESS_CACHE_SIZE
+    global TRACK_STORE_SIZE_MB
+    global MPI_PROTOCOL
+    global TASK_CHUNK_SIZE
+    global EVALUATION_MODE
+    global EARLY_ABORT_CHUNK_SIZE
+    global RACING_MIN_SEQUENCES
+    global RACING_BATCH_SIZE
+    global RACING_T_THRESHOLD
+    global MIGRATION_INTERVAL
+    global MIGRANTS
+    global ASYNC_EXPORT
+    global METRICS
+    global PLACEMENT_BACKEND
+    global NUM_THREADS
+    global PLACEMENT_BATCH_SIZE
+    global METRICS_FORMAT
+    global PRINT_PLACEMENT
+    global CHECKPOINT_FILENAME
+    global CHECKPOINT_INPUT_FILENAME
+    global PERIODIC_CHECKPOINT
     global POPULATION_ORIGIN
     global POPULATION_FILL_TYPE
     global INPUT_FILENAME
@@ -880,6 +1736,7 @@ def set_up():
     global configPssm
     
     # MPI variables  # XXX
+    global MPI
     global comm
     global rank
     global p
@@ -891,6 +1748,14 @@ def set_up():
         raise Exception("POPULATION_LENGTH must be an even number.")
     
     RUN_MODE = config["main"]["RUN_MODE"]  # XXX
+    MPI_PROTOCOL = config["main"]["MPI_PROTOCOL"]
+    NUM_THREADS = config["main"]["NUM_THREADS"]
+    if NUM_THREADS < 1:
+        raise ValueError("NUM_THREADS should be at least 1.")
+    if MPI_PROTOCOL not in ["scatter", "persistent", "tasks", "islands"]:
+        raise ValueError('MPI_PROTOCOL should be "scatter", "persistent", '
+                         '"tasks" or "islands".')
+    TASK_CHUNK_SIZE = config["main"]["TASK_CHUNK_SIZE"]
     if RUN_MODE == "parallel":
         from mpi4py import MPI  # mpi4py is only imported if needed
         comm = MPI.COMM_WORLD
@@ -924,13 +1789,43 @@ def set_up():
     MIN_ITERATIONS = config["main"]["MIN_ITERATIONS"]
     MIN_FITNESS = config["main"]["MIN_FITNESS"]
     THRESHOLD = config["main"]["THRESHOLD"]
+    FITNESS_CACHE_SIZE = config["main"]["FITNESS_CACHE_SIZE"]
+    TRACK_STORE_SIZE_MB = config["main"]["TRACK_STORE_SIZE_MB"]
+    EVALUATION_MODE = config["main"]["EVALUATION_MODE"]
+    if EVALUATION_MODE not in ["full", "early_abort", "racing"]:
+        raise ValueError('EVALUATION_MODE should be "full", "early_abort" or '
+                         '"racing".')
+    EARLY_ABORT_CHUNK_SIZE = config["main"]["EARLY_ABORT_CHUNK_SIZE"]
+    PLACEMENT_BATCH_SIZE = config["main"]["PLACEMENT_BATCH_SIZE"]
+    # The configured backend is checked, even if it falls back to the CPU
+    check_placement_backend(config["main"]["PLACEMENT_BACKEND"],
+                            EVALUATION_MODE, RUN_MODE, MPI_PROTOCOL)
+    PLACEMENT_BACKEND = population_engine.set_backend(
+        config["main"]["PLACEMENT_BACKEND"])
+    RACING_MIN_SEQUENCES = config["main"]["RACING_MIN_SEQUENCES"]
+    RACING_BATCH_SIZE = config["main"]["RACING_BATCH_SIZE"]
+    RACING_T_THRESHOLD = config["main"]["RACING_T_THRESHOLD"]
+    MIGRATION_INTERVAL = config["main"]["MIGRATION_INTERVAL"]
+    MIGRANTS = config["main"]["MIGRANTS"]
     END_WHILE_METHOD = config["main"]["END_WHILE_METHOD"]
     POPULATION_ORIGIN = config["main"]["POPULATION_ORIGIN"]
+    CHECKPOINT_FILENAME = config["main"]["CHECKPOINT_FILENAME"]
+    CHECKPOINT_INPUT_FILENAME = config["main"]["CHECKPOINT_INPUT_FILENAME"]
+    PERIODIC_CHECKPOINT = config["main"]["PERIODIC_CHECKPOINT"]
+    if RUN_MODE == "parallel" and MPI_PROTOCOL == "islands" and (
+            PERIODIC_CHECKPOINT > 0 or POPULATION_ORIGIN == "checkpoint"):
+        # Checkpoints are collective, and islands are never synchronized
+        raise ValueError('Checkpoints are not available with the "islands" '
+                         'MPI_PROTOCOL: set PERIODIC_CHECKPOINT to 0.')
     POPULATION_FILL_TYPE = config["main"]["POPULATION_FILL_TYPE"]
     INPUT_FILENAME = config["main"]["INPUT_FILENAME"]
     OUTPUT_FILENAME = config["main"]["OUTPUT_FILENAME"]
     PERIODIC_ORG_EXPORT = config["main"]["PERIODIC_ORG_EXPORT"]
     PERIODIC_POP_EXPORT = config["main"]["PERIODIC_POP_EXPORT"]
+    ASYNC_EXPORT = config["main"]["ASYNC_EXPORT"]
+    METRICS = config["main"]["METRICS"]
+    METRICS_FORMAT = config["main"]["METRICS_FORMAT"]
+    PRINT_PLACEMENT = config["main"]["PRINT_PLACEMENT"]
     MAX_NODES = config["organism"]["MAX_NODES"]
     MIN_NODES = config["organism"]["MIN_NODES"]
     
@@ -939,6 +1834,11 @@ def set_up():
         check_dir(RESULT_BASE_PATH_DIR)
         check_dir(RESULT_BASE_PATH_DIR + "population")
         check_dir(RESULT_BASE_PATH_DIR + "plots")
+    # The other processes write their metrics in the same directory (which
+    # exists from now on)
+    if RUN_MODE == "parallel":
+        RESULT_BASE_PATH_DIR = mpi_transport.collective(
+            comm.bcast, RESULT_BASE_PATH_DIR, root=0)
 
     # Store Config into variables to use later
     configOrganism = config["organism"]
@@ -1087,6 +1987,38 @@ def gini_RSV(values_for_each_class):
     return giniRSV
 
 
+def check_placement_backend(backend, evaluation_mode, run_mode,
+                            mpi_protocol) -> None:
+    '''
+    Raises a ValueError if the "gpu" PLACEMENT_BACKEND is requested with an
+    evaluation that can't use it: the whole population is placed at once, so
+    no decision can be taken during the evaluation ("full" EVALUATION_MODE
+    only), and the placements can't be split into tasks.
+    '''
+    if backend == "gpu" and (
+            evaluation_mode != "full"
+            or (run_mode == "parallel" and mpi_protocol == "tasks")):
+        raise ValueError('The "gpu" PLACEMENT_BACKEND requires the "full" '
+                         'EVALUATION_MODE, and is not available with the '
+                         '"tasks" MPI_PROTOCOL.')
+
+
+def get_sendcounts(population_length):
+    '''
+    Returns the number of organisms assigned to each process, when a
+    population of the given length is distributed as evenly as possible by
+    pairs (see fragment_population).
+    '''
+    # Number of pairs of organisms
+    n_pairs = int(population_length / 2)
+    q = n_pairs // p  # p is the number of processes
+    r = n_pairs % p  # p is the number of processes
+    # Number of pairs of organisms assigned to each process
+    local_n_pairs_list = [q + 1] * r + [q] * (p - r)
+    # Number of organisms assigned to each process
+    return [n*2 for n in local_n_pairs_list]
+
+
 def fragment_population(population):
     '''
     This function is used when running the pipeline in parallel mode via MPI.
@@ -1112,14 +2044,8 @@ def fragment_population(population):
     if population is None:
         return None
     
-    # Number of pairs of organisms
-    n_pairs = int(len(population) / 2)
-    q = n_pairs // p  # p is the number of processes
-    r = n_pairs % p  # p is the number of processes
-    # Number of pairs of organisms assigned to each process
-    local_n_pairs_list = [q + 1] * r + [q] * (p - r)
     # Number of organisms assigned to each process
-    sendcounts = [n*2 for n in local_n_pairs_list]
+    sendcounts = get_sendcounts(len(population))
     # Make a list where each element is the list of organism for a process
     it = iter(population)
     population = [[next(it) for _ in range(size)] for size in sendcounts]
@@ -1148,6 +2074,178 @@ def flatten_population(population):
     return flat_population
 
 
+def redistribute_population(local_population, rng, factory):
+    '''
+    This function is used when running the pipeline in parallel mode via MPI,
+    with the persistent protocol.
+    It shuffles the population, distributed over the processes, as if the
+    whole population was shuffled and fragmented again (see
+    fragment_population). The permutation is generated with a random generator
+    shared by all the processes (rng), so it doesn't need to be communicated.
+    The organisms that stay on the same process are not copied. The ones that
+    move to another process are sent as compact genomes (see
+    OrganismFactory.get_compact_genome), all in one alltoall exchange.
+    '''
+    sendcounts = get_sendcounts(POPULATION_LENGTH)
+    # First global position assigned to each process
+    offsets = [sum(sendcounts[:r]) for r in range(p)]
+    # Process owning each global position
+    owners = [r for r in range(p) for _ in range(sendcounts[r])]
+    
+    # Position q of the shuffled population is assigned the organism in
+    # position permutation[q]
+    permutation = list(range(POPULATION_LENGTH))
+    rng.shuffle(permutation)
+    
+    new_local_population = [None] * sendcounts[rank]
+    outgoing = [[] for _ in range(p)]
+    for new_pos, old_pos in enumerate(permutation):
+        if owners[old_pos] != rank:
+            continue
+        organism = local_population[old_pos - offsets[rank]]
+        if owners[new_pos] == rank:
+            new_local_population[new_pos - offsets[rank]] = organism
+        else:
+            outgoing[owners[new_pos]].append(
+                (new_pos, factory.get_compact_genome(organism)))
+    
+    incoming = mpi_transport.collective(comm.alltoall, outgoing)
+    for messages in incoming:
+        for new_pos, genome in messages:
+            new_local_population[new_pos - offsets[rank]] = (
+                factory.get_organism_from_compact_genome(genome))
+    
+    return new_local_population
+
+
+def gather_population(local_population, factory):
+    '''
+    Gathers the whole population on process 0 (persistent protocol), sending
+    compact genomes. Returns None on the other processes.
+    '''
+    genomes = [factory.get_compact_genome(org) for org in local_population]
+    genomes = mpi_transport.collective(comm.gather, genomes, root=0)
+    if not i_am_main_process():
+        return None
+    return [factory.get_organism_from_compact_genome(genome)
+            for genome in flatten_population(genomes)]
+
+
+def gather_max_organism(local_max_organism, factory):
+    '''
+    Returns, on process 0, the organism with highest fitness among the ones
+    with highest fitness on each process (persistent protocol), as a
+    (organism, fitness, number of nodes) tuple. Returns None on the other
+    processes.
+    '''
+    organism, fitness, nodes = local_max_organism
+    genome = factory.get_compact_genome(organism) if organism is not None else None
+    summaries = mpi_transport.collective(comm.gather, (genome, fitness, nodes),
+                                         root=0)
+    if not i_am_main_process():
+        return None
+    genome, fitness, nodes = max(summaries, key=lambda summary: summary[1])
+    return (factory.get_organism_from_compact_genome(genome), fitness, nodes)
+
+
+def save_checkpoint(filename, iterations, population, best_organism, max_score,
+                    last_max_score, plot_stats, positive_dataset,
+                    negative_dataset, factory) -> None:
+    '''
+    Writes a checkpoint of the run, to be resumed with POPULATION_ORIGIN
+    "checkpoint". It must be called by all the processes: the random
+    generator states and the organism ID counters of every process are
+    gathered. The population (on process 0) is stored as compact genomes (see
+    OrganismFactory.get_compact_genome), together with the iteration
+    counter, the scores, the best organism, the statistics of the plots and
+    the datasets (the order of the positive set and the whole negative set,
+    which may have been generated).
+    The file is written with pickle, and replaced atomically.
+    '''
+    process_state = (random.getstate(), np.random.get_state(),
+                     factory._organism_counter)
+    if RUN_MODE == 'parallel':
+        process_states = mpi_transport.collective(comm.gather, process_state,
+                                                  root=0)
+    else:
+        process_states = [process_state]
+    if not i_am_main_process():
+        return
+    
+    best = None
+    if best_organism[0] is not None:
+        best = (factory.get_compact_genome(best_organism[0]), best_organism[1],
+                best_organism[2])
+    state = {
+        "version": CHECKPOINT_VERSION,
+        "iterations": iterations,
+        "max_score": max_score,
+        "last_max_score": last_max_score,
+        "plot_stats": plot_stats,
+        "population": [factory.get_compact_genome(org) for org in population],
+        "best_organism": best,
+        "process_states": process_states,
+        "positive_order": positive_dataset.order,
+        "negative_dataset": negative_dataset,
+    }
+    tmp_filename = filename + ".tmp"
+    with open(tmp_filename, "wb") as checkpoint_file:
+        pickle.dump(state, checkpoint_file, protocol=pickle.HIGHEST_PROTOCOL)
+    os.replace(tmp_filename, filename)
+
+
+def load_checkpoint(filename) -> dict:
+    '''
+    Reads a checkpoint written by save_checkpoint. It must be called by all
+    the processes, and the number of processes must be the same as in the
+    interrupted run. Returns the state for this process: the random generator
+    states and organism ID counter of the process ("random_state",
+    "numpy_random_state", "organism_counter"), plus all the other values
+    stored by save_checkpoint ("population" is only returned to process 0).
+    The checkpoint is read and checked by process 0: if it can't be resumed,
+    the error is sent to all the processes, which all raise it.
+    '''
+    state = None
+    error = None
+    if i_am_main_process():
+        try:
+            with open(filename, "rb") as checkpoint_file:
+                state = pickle.load(checkpoint_file)
+        except (OSError, pickle.UnpicklingError, EOFError) as read_error:
+            error = "Cannot read the checkpoint {}: {}".format(filename,
+                                                              read_error)
+        n_processes = p if RUN_MODE == 'parallel' else 1
+        if error is None and state.get("version") != CHECKPOINT_VERSION:
+            error = "Unsupported checkpoint version: " + str(state.get("version"))
+        elif error is None and len(state["process_states"]) != n_processes:
+            error = ("The checkpoint was written by "
+                     + str(len(state["process_states"]))
+                     + " processes, not " + str(n_processes) + ".")
+    
+    # The other processes would otherwise wait for the scatter
+    if RUN_MODE == 'parallel':
+        error = mpi_transport.collective(comm.bcast, error, root=0)
+    if error is not None:
+        raise ValueError(error)
+    
+    if RUN_MODE == 'parallel':
+        process_states = state["process_states"] if i_am_main_process() else None
+        process_state = mpi_transport.collective(
+            comm.scatter, process_states, root=0)
+        population = None
+        if i_am_main_process():
+            population = state.pop("population")
+            del state["process_states"]
+        state = mpi_transport.collective(comm.bcast, state, root=0)
+        state["population"] = population
+    else:
+        process_state = state["process_states"][0]
+    
+    state["random_state"], state["numpy_random_state"], \
+        state["organism_counter"] = process_state
+    return state
+
+
 # Entry point to app execution
 # It calculates the time, but could include other app stats
 
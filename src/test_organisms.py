@@ -1,173 +1,217 @@
 # -*- coding: utf-8 -*-
-"""Tests an organism Fitness
+"""Tests the fitness of evolved organisms
+
+The organisms imported from INPUT_FILENAME are evaluated on the positive and
+negative datasets (the first MAX_SEQUENCES_TO_FIT_POS and
+MAX_SEQUENCES_TO_FIT_NEG sequences). Each organism is placed once on each
+dataset, and all the fitness values (discriminative, Welch's, Boltzmannian,
+Kolmogorov) are computed from the same binding energies. Organisms are
+evaluated in parallel by a pool of processes (TEST_PROCESSES; all the CPUs
+if it's null): the organisms are imported once, by the main process, and
+sent to the pool as compact genomes (see OrganismFactory.get_compact_genome),
+one per task. Each process reads the datasets once.
+
+The results are written to one tab-separated report (TEST_REPORT_FILENAME,
+in RESULT_TEST_BASE_PATH_DIR), one line per organism, in the order of the
+input file. With TEST_EXPORT, the placements of each organism on the datasets
+and the histograms of its energies are exported too.
+
 """
 
+import time
+import multiprocessing
+import numpy as np
+from matplotlib.figure import Figure
 from search_organisms import read_fasta_file, read_json_file, export_organism
 from objects.organism_factory import OrganismFactory
-import json
-import numpy as np
-import matplotlib.pyplot as plt
-import time
+from objects.dataset_object import DatasetObject
+from objects.sequence_block_object import SequenceBlockObject
+from objects import fitness_functions
 
 CONFIG_FILE = "config.json"
 
-def main():
-    """Main execution for the test organisms
+# Columns of the report
+REPORT_COLUMNS = ["organism", "nodes", "P", "P_stdev", "N", "N_stdev",
+                  "discriminative", "welchs", "boltzmannian", "kolmogorov",
+                  "seconds"]
+
+# State of each process of the pool (set by init_worker)
+worker_config: dict = {}
+worker_factory: OrganismFactory = None
+# Positive and negative datasets, and the blocks of the sequences evaluated
+worker_datasets: tuple = ()
+worker_blocks: tuple = ()
+
 
+def get_factory(config: dict) -> OrganismFactory:
+    """Returns the organism factory of the configuration.
     """
-    #read configuration file
-    config = read_json_file(CONFIG_FILE)
-    positive_path = (
-        config["main"]["DATASET_BASE_PATH_DIR"]
-        + config["main"]["POSITIVE_FILENAME"]
-    )
-    negative_path = (
-        config["main"]["DATASET_BASE_PATH_DIR"]
-        + config["main"]["NEGATIVE_FILENAME"]
-    )
-    max_sequences_to_fit_pos = config["main"]["MAX_SEQUENCES_TO_FIT_POS"]
-    max_sequences_to_fit_neg = config["main"]["MAX_SEQUENCES_TO_FIT_NEG"]
-
-    input_organisms_path = config["main"]["INPUT_FILENAME"]
-    positive_dataset = read_fasta_file(positive_path)
-    #positive_dataset.sort()
-    negative_dataset = read_fasta_file(negative_path)
-    #print("{} {}".format(len(positive_dataset), len(negative_dataset)))
-    
-    genome_length = config["main"]["GENOME_LENGTH"]
-    
-    organism_factory = OrganismFactory(
+    return OrganismFactory(
         config["organism"],
         config["organismFactory"],
         config["connector"],
         config["pssm"],
+        None
     )
-    
-    # create organisms in input file
-    a_organisms = organism_factory.import_organisms(input_organisms_path)
-
-    # for each organism: compute Boltzmann, Gini and discrmiminative fitness
-    # write out on console the results
-    # export the placement of the organism against each pos/neg set sequence
-    for org in a_organisms:
-        
-        # start_time = time.time()
-
-        nodes = org.count_nodes()
-        
-        # Boltzmannian fitness
-        performance1 = org.get_boltz_fitness(positive_dataset[:max_sequences_to_fit_pos],
-                                             negative_dataset[:max_sequences_to_fit_neg],
-                                             genome_length, use_gini=True)
-        boltz_fitness = performance1["score"]
-
-        # Gini coefficient
-        gini_coeff = performance1["avg_gini"]
-        
-        # Kolmogorov fitness
-        performance1 = org.get_kolmogorov_fitness(positive_dataset[:max_sequences_to_fit_pos],
-                                             negative_dataset[:max_sequences_to_fit_neg],
-                                             use_gini=False)
-        kolm_fitness = performance1["score"]
-        
-        
-        # print("Boltzmann --- %s seconds ---" % (time.time() - start_time))
-        
-        # start_time = time.time()
-        
-        # Discriminative fitness
-        Pf = org.get_additive_fitness(positive_dataset[:max_sequences_to_fit_pos],
-                                      use_gini=False)
-        P = Pf["score"]
-        Pstd = Pf["stdev"]
-        
-        Nf = org.get_additive_fitness(negative_dataset[:max_sequences_to_fit_neg],
-                                      use_gini=False)
-        N = Nf["score"]
-        Nstd = Nf["stdev"]
-        
-        discr_fitness =  P - N
-        # print("Additive --- %s seconds ---" % (time.time() - start_time))
-        
-        
-        # Welch's fitness
-        if Pstd < 1:
-            Pstd_for_welchs = 1
-        else:
-            Pstd_for_welchs = Pstd
-        
-        if Nstd < 1:
-            Nstd_for_welchs = 1
-        else:
-            Nstd_for_welchs = Nstd
-        
-        sterr_P = Pstd_for_welchs / max_sequences_to_fit_pos**(1/2)
-        sterr_N = Nstd_for_welchs / max_sequences_to_fit_neg**(1/2)
-        welchs_fitness =  (P - N) / (sterr_P**2 + sterr_N**2)**(1/2)
-        
-        
-        # Distribution plotting
-        Pe = org.get_binding_energies(positive_dataset[:max_sequences_to_fit_pos],
-                                     traceback=False, use_gini=False)
-        
-        Ne = org.get_binding_energies(negative_dataset[:max_sequences_to_fit_neg],
-                                      traceback=False, use_gini=False)
-        
-        plt.hist(Pe, alpha=0.5, label='positive set')
-        plt.hist(Ne, alpha=0.5, label='negative set')
-        plt.legend()
-        plt.savefig('org_' + str(org._id) + '_energy_distr')
-        plt.close()
-        
-        # print out results (fitness, nodes, Gini, etc.) for organism
-        print(
-            (
-                "Org {} Nodes: {:.2f} GiniPSSMs: {:.2f} P: {:.2f}(+/-){:.2f} N: {:.2f}(+/-){:.2f}"
-                + " DiscrF: {:.2f} BoltzF: {:.2f} KolmF: {:.2f} WelchsF: {:.2f}\n"
-            ).format(
-                org._id,  # "Org"
-                nodes,  # "Nodes"
-                gini_coeff, # GiniPSSMs
-                P,  # "P"
-                Pstd, # stdev for P
-                N,  # "N"
-                Nstd, # stdev for N
-                discr_fitness,  # "DiscrF"
-                boltz_fitness,  # "BoltzF"
-                kolm_fitness,    # "KolmF"
-                welchs_fitness  # "WelchF"
-                )
-        )
-        
-                
-        #export the organism results on the positive dataset
-        export_organism(
-            org,
-            positive_dataset,
-            "{}positive_{}".format(
-                config["main"]["RESULT_TEST_BASE_PATH_DIR"], org._id
-            ),
-            organism_factory,
-        )
 
+
+def init_worker(config: dict) -> None:
+    """Initializes a process of the pool: reads the datasets.
+    """
+    global worker_config, worker_factory
+    global worker_datasets, worker_blocks
+    conf_main = config["main"]
+
+    worker_config = config
+    positive_dataset = DatasetObject(read_fasta_file(
+        conf_main["DATASET_BASE_PATH_DIR"] + conf_main["POSITIVE_FILENAME"]))
+    negative_dataset = DatasetObject(read_fasta_file(
+        conf_main["DATASET_BASE_PATH_DIR"] + conf_main["NEGATIVE_FILENAME"]))
+    worker_datasets = (positive_dataset, negative_dataset)
+    worker_blocks = (
+        SequenceBlockObject(positive_dataset[:conf_main["MAX_SEQUENCES_TO_FIT_POS"]]),
+        SequenceBlockObject(negative_dataset[:conf_main["MAX_SEQUENCES_TO_FIT_NEG"]]))
+
+    worker_factory = get_factory(config)
+
+
+def export_energy_histogram(pos_energies, neg_energies, filename: str) -> None:
+    """Saves the histograms of the energies of an organism on the positive
+       and on the negative dataset.
+    """
+    figure = Figure()
+    axes = figure.subplots()
+    axes.hist(pos_energies, alpha=0.5, label='positive set')
+    axes.hist(neg_energies, alpha=0.5, label='negative set')
+    axes.legend()
+    figure.savefig(filename)
+
+
+def evaluate_organism(genome: tuple) -> dict:
+    """Evaluates one of the imported organisms, given its compact genome (it
+       keeps the ID given by the import).
+
+    Returns:
+        the values of the REPORT_COLUMNS for the organism
+    """
+    start_time = time.time()
+    conf_main = worker_config["main"]
+    org = worker_factory.get_organism_from_compact_genome(genome)
+    # The organism is placed once on each dataset: don't keep placement
+    # checkpoints nor cached placements
+    org.max_placement_checkpoints = 0
+    org.placement_cache_size = 0
+    positive_block, negative_block = worker_blocks
+    method = org.cumulative_fit_method
+
+    # The only placements of the organism on the samples
+    pos_energies = np.array(org.get_binding_energies(positive_block), dtype=float)
+    neg_energies = np.array(org.get_binding_energies(negative_block), dtype=float)
+
+    P, P_stdev = fitness_functions.get_additive_score(pos_energies, method)
+    N, N_stdev = fitness_functions.get_additive_score(neg_energies, method)
+    result = {
+        "organism": org._id,
+        "nodes": org.count_nodes(),
+        "P": P,
+        "P_stdev": P_stdev,
+        "N": N,
+        "N_stdev": N_stdev,
+        "discriminative": P - N,
+        "welchs": fitness_functions.get_welchs_score(
+            pos_energies, neg_energies, method,
+            conf_main["MAX_SEQUENCES_TO_FIT_POS"],
+            conf_main["MAX_SEQUENCES_TO_FIT_NEG"]),
+        "boltzmannian": org.get_boltz_fitness(
+            positive_block, negative_block, conf_main["GENOME_LENGTH"],
+            pos_energies, neg_energies)["score"],
+        "kolmogorov": org.get_kolmogorov_fitness(
+            positive_block, negative_block, pos_energies=pos_energies,
+            neg_energies=neg_energies)["score"],
+    }
+
+    if worker_config["test"]["TEST_EXPORT"]:
+        base_path = conf_main["RESULT_TEST_BASE_PATH_DIR"]
+        export_energy_histogram(
+            pos_energies, neg_energies,
+            "{}org_{}_energy_distr".format(base_path, org._id))
+        positive_dataset, negative_dataset = worker_datasets
+        #export the organism results on the positive dataset
+        export_organism(org, positive_dataset,
+                        "{}positive_{}".format(base_path, org._id),
+                        worker_factory)
         #export the organism results on the negative dataset
-        export_organism(
-            org,
-            negative_dataset[:50],
-            "{}negative_{}".format(
-                config["main"]["RESULT_TEST_BASE_PATH_DIR"], org._id
-            ),
-            organism_factory,
-        )
-    
-    print("\n(Energy histograms are saved in the current working directory)")
-        
+        export_organism(org, negative_dataset[:50],
+                        "{}negative_{}".format(base_path, org._id),
+                        worker_factory)
 
-if __name__ == "__main__":
-    
-    # TODO: Add the profiler here to improve the fitness calculation performance
-    
-    main()
+    result["seconds"] = time.time() - start_time
+    return result
+
+
+def get_report_line(result: dict) -> str:
+    """Returns the line of the report of an organism (tab-separated).
+    """
+    values = []
+    for column in REPORT_COLUMNS:
+        value = result[column]
+        if isinstance(value, float):
+            values.append("{:.8g}".format(value))
+        else:
+            values.append(str(value))
+    return "\t".join(values)
+
+
+def main():
+    """Main execution for the test organisms
+
+    """
+    #read configuration file
+    config = read_json_file(CONFIG_FILE)
+    conf_test = config["test"]
+    report_path = (
+        config["main"]["RESULT_TEST_BASE_PATH_DIR"]
+        + conf_test["TEST_REPORT_FILENAME"]
+    )
+    n_processes = conf_test["TEST_PROCESSES"]
+    if n_processes is None:
+        n_processes = multiprocessing.cpu_count()
 
+    if config["main"]["NEGATIVE_FILENAME"] is None:
+        raise ValueError("test_organisms requires a NEGATIVE_FILENAME.")
 
+    start_time = time.time()
+    # The organisms are imported once: the processes get compact genomes
+    factory = get_factory(config)
+    genomes = [factory.get_compact_genome(org)
+               for org in factory.import_organisms(
+                   config["main"]["INPUT_FILENAME"])]
+    n_organisms = len(genomes)
 
+    with multiprocessing.Pool(n_processes, init_worker, (config,)) as pool, \
+         open(report_path, "w") as report:
+        report.write("\t".join(REPORT_COLUMNS) + "\n")
+        # Results are written in the order of the input file, as they arrive
+        for result in pool.imap(evaluate_organism, genomes):
+            report.write(get_report_line(result) + "\n")
+            report.flush()
+            print(
+                (
+                    "Org {} Nodes: {:.2f} P: {:.2f}(+/-){:.2f} N: {:.2f}(+/-){:.2f}"
+                    + " DiscrF: {:.2f} BoltzF: {:.2f} KolmF: {:.2f} WelchsF: {:.2f}"
+                ).format(
+                    result["organism"], result["nodes"], result["P"],
+                    result["P_stdev"], result["N"], result["N_stdev"],
+                    result["discriminative"], result["boltzmannian"],
+                    result["kolmogorov"], result["welchs"]
+                )
+            )
+
+    elapsed = time.time() - start_time
+    print("\nEvaluated {} organisms in {:.2f}s: report written to {}".format(
+        n_organisms, elapsed, report_path))
+
+
+if __name__ == "__main__":
+
+    main()